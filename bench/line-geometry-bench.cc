@@ -0,0 +1,134 @@
+/**
+ * Benchmark of the batched line geometry kernel against a per line computation
+ *
+ * @version $Version: 2024.04.16$
+ * @author Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @copyright Copyright (c) 2015-present, Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @link https://github.com/mauvilsa/tesseract-recognize
+ * @license MIT License
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "../line-geometry.h"
+
+struct Point {
+  double x, y;
+};
+
+/// Per line computation as done for each TextLine node before batching ///
+struct Line {
+  Point coords[4];
+  Point b1, b2;
+};
+
+static bool intersection( Point line1_point1, Point line1_point2, Point line2_point1, Point line2_point2, Point& _ipoint ) {
+  Point x = { line2_point1.x-line1_point1.x, line2_point1.y-line1_point1.y };
+  Point direct1 = { line1_point2.x-line1_point1.x, line1_point2.y-line1_point1.y };
+  Point direct2 = { line2_point2.x-line2_point1.x, line2_point2.y-line2_point1.y };
+  double cross = direct1.x*direct2.y - direct1.y*direct2.x;
+  if ( std::fabs(cross) < 1e-8 )
+    return false;
+  double t1 = ( x.x*direct2.y - x.y*direct2.x ) / cross;
+  _ipoint.x = line1_point1.x + t1*direct1.x;
+  _ipoint.y = line1_point1.y + t1*direct1.y;
+  return true;
+}
+
+static double norm( Point a, Point b ) {
+  return std::sqrt( (a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) );
+}
+
+__attribute__((noinline)) static bool lineGeometry( const Line& line, Point& p1, Point& p2, double& height, double& offset ) {
+  if ( ! intersection( line.b1, line.b2, line.coords[0], line.coords[3], p1 ) ||
+       ! intersection( line.b1, line.b2, line.coords[1], line.coords[2], p2 ) )
+    return false;
+  double up1 = norm( p1, line.coords[0] );
+  double up2 = norm( p2, line.coords[1] );
+  double down1 = norm( p1, line.coords[3] );
+  double down2 = norm( p2, line.coords[2] );
+  double h = 0.5*( up1 + up2 + down1 + down2 );
+  offset = h <= 0.0 ? 0.0 : 0.5*( down1 + down2 ) / h;
+  height = h <= 0.0 ? 1.0 : h;
+  return true;
+}
+
+int main( int argc, char *argv[] ) {
+  int num = argc > 1 ? atoi(argv[1]) : 200000;
+  int reps = argc > 2 ? atoi(argv[2]) : 20;
+  if ( num <= 0 || reps <= 0 ) {
+    fprintf( stderr, "usage: %s [NUM_LINES] [REPETITIONS]\n", argv[0] );
+    return 1;
+  }
+
+  /// Random line boxes and slightly slanted baselines, a few degenerate ///
+  srand( 1 );
+  std::vector<Line> lines( num );
+  LineArrays arrays;
+  for ( auto& line : lines ) {
+    double left = rand() % 3000;
+    double top = rand() % 4000;
+    double right = left + 50 + rand() % 1500;
+    double bottom = top + 10 + rand() % 80;
+    line.coords[0] = { left, top };
+    line.coords[1] = { right, top };
+    line.coords[2] = { right, bottom };
+    line.coords[3] = { left, bottom };
+    double base = bottom - 0.2*(bottom-top);
+    line.b1 = { left + rand() % 20, base + rand() % 5 - 2 };
+    line.b2 = { right - rand() % 20, base + rand() % 5 - 2 };
+    if ( rand() % 1000 == 0 ) // degenerate baseline without intersections
+      line.b2 = line.b1;
+    const double corners[8] = { left, top, right, top, right, bottom, left, bottom };
+    addLineArrays( arrays, corners, line.b1.x, line.b1.y, line.b2.x, line.b2.y );
+  }
+
+  std::vector<Point> p1( num ), p2( num );
+  std::vector<double> height( num ), offset( num );
+  std::vector<double> out( 6*num );
+  std::vector<unsigned char> found( num );
+
+  double per_line = 1e300;
+  double batched = 1e300;
+  double sum = 0.0;
+  for ( int r=0; r<reps; r++ ) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( int i=0; i<num; i++ )
+      found[i] = lineGeometry( lines[i], p1[i], p2[i], height[i], offset[i] );
+    per_line = std::min( per_line, std::chrono::duration<double,std::nano>( std::chrono::steady_clock::now() - start ).count() );
+    sum += height[r%num];
+
+    start = std::chrono::steady_clock::now();
+    lineGeometryKernel( arrays, &out[0], &out[num], &out[2*num], &out[3*num], &out[4*num], &out[5*num] );
+    batched = std::min( batched, std::chrono::duration<double,std::nano>( std::chrono::steady_clock::now() - start ).count() );
+    sum += out[4*num+r%num];
+  }
+
+  /// Both have to give the same results ///
+  double maxdiff = 0.0;
+  for ( int i=0; i<num; i++ ) {
+    bool ok = lineGeometry( lines[i], p1[i], p2[i], height[i], offset[i] );
+    if ( ok != ( out[4*num+i] != 0.0 ) ) {
+      maxdiff = 1e300;
+      break;
+    }
+    if ( ! ok )
+      continue;
+    maxdiff = std::max( maxdiff, std::fabs( p1[i].x - out[i] ) );
+    maxdiff = std::max( maxdiff, std::fabs( p1[i].y - out[num+i] ) );
+    maxdiff = std::max( maxdiff, std::fabs( p2[i].x - out[2*num+i] ) );
+    maxdiff = std::max( maxdiff, std::fabs( p2[i].y - out[3*num+i] ) );
+    maxdiff = std::max( maxdiff, std::fabs( height[i] - out[4*num+i] ) );
+    maxdiff = std::max( maxdiff, std::fabs( offset[i] - out[5*num+i] ) );
+  }
+
+  printf( "lines: %d, best of %d repetitions (checksum %g)\n", num, reps, sum );
+  printf( "per line: %8.2f ns/line\n", per_line/num );
+  printf( "batched:  %8.2f ns/line (%.2fx)\n", batched/num, per_line/batched );
+  printf( "max abs difference: %g\n", maxdiff );
+  return maxdiff > 1e-6 ? 1 : 0;
+}
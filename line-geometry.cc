@@ -0,0 +1,52 @@
+/**
+ * Batched computation of the baselines and polystripes of text lines.
+ *
+ * @version $Version: 2024.04.16$
+ * @author Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @copyright Copyright (c) 2015-present, Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @link https://github.com/mauvilsa/tesseract-recognize
+ * @license MIT License
+ */
+
+#include <cmath>
+
+#include "line-geometry.h"
+
+void lineGeometryKernel( const LineArrays& g, double* __restrict__ p1x, double* __restrict__ p1y, double* __restrict__ p2x, double* __restrict__ p2y, double* __restrict__ height, double* __restrict__ offset ) {
+  const int num = (int)g.c0x.size();
+  const double* __restrict__ c0x = g.c0x.data(); const double* __restrict__ c0y = g.c0y.data();
+  const double* __restrict__ c1x = g.c1x.data(); const double* __restrict__ c1y = g.c1y.data();
+  const double* __restrict__ c2x = g.c2x.data(); const double* __restrict__ c2y = g.c2y.data();
+  const double* __restrict__ c3x = g.c3x.data(); const double* __restrict__ c3y = g.c3y.data();
+  const double* __restrict__ b1x = g.b1x.data(); const double* __restrict__ b1y = g.b1y.data();
+  const double* __restrict__ b2x = g.b2x.data(); const double* __restrict__ b2y = g.b2y.data();
+  for ( int i=0; i<num; i++ ) {
+    double dx = b2x[i] - b1x[i];
+    double dy = b2y[i] - b1y[i];
+    double lx = c3x[i] - c0x[i];
+    double ly = c3y[i] - c0y[i];
+    double rx = c2x[i] - c1x[i];
+    double ry = c2y[i] - c1y[i];
+    double lcross = dx*ly - dy*lx;
+    double rcross = dx*ry - dy*rx;
+    bool valid = ( std::fabs(lcross) >= 1e-8 ) & ( std::fabs(rcross) >= 1e-8 );
+    double lt = ( (c0x[i]-b1x[i])*ly - (c0y[i]-b1y[i])*lx ) / ( valid ? lcross : 1.0 );
+    double rt = ( (c1x[i]-b1x[i])*ry - (c1y[i]-b1y[i])*rx ) / ( valid ? rcross : 1.0 );
+    double q1x = b1x[i] + lt*dx;
+    double q1y = b1y[i] + lt*dy;
+    double q2x = b1x[i] + rt*dx;
+    double q2y = b1y[i] + rt*dy;
+    double up1 = std::sqrt( (q1x-c0x[i])*(q1x-c0x[i]) + (q1y-c0y[i])*(q1y-c0y[i]) );
+    double up2 = std::sqrt( (q2x-c1x[i])*(q2x-c1x[i]) + (q2y-c1y[i])*(q2y-c1y[i]) );
+    double down1 = std::sqrt( (q1x-c3x[i])*(q1x-c3x[i]) + (q1y-c3y[i])*(q1y-c3y[i]) );
+    double down2 = std::sqrt( (q2x-c2x[i])*(q2x-c2x[i]) + (q2y-c2y[i])*(q2y-c2y[i]) );
+    double h = 0.5*( up1 + up2 + down1 + down2 );
+    h = h <= 0.0 ? 1.0 : h; // if zero so are the downs and the offset
+    p1x[i] = q1x;
+    p1y[i] = q1y;
+    p2x[i] = q2x;
+    p2y[i] = q2y;
+    offset[i] = 0.5*( down1 + down2 ) / h;
+    height[i] = valid ? h : 0.0;
+  }
+}
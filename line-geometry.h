@@ -0,0 +1,54 @@
+/**
+ * Batched computation of the baselines and polystripes of text lines.
+ *
+ * @version $Version: 2024.04.16$
+ * @author Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @copyright Copyright (c) 2015-present, Mauricio Villegas <mauricio_ville@yahoo.com>
+ * @link https://github.com/mauvilsa/tesseract-recognize
+ * @license MIT License
+ */
+
+#ifndef __LINE_GEOMETRY_H__
+#define __LINE_GEOMETRY_H__
+
+#include <vector>
+
+/**
+ * Coordinates of the lines of a page kept in separate arrays (corners 0-3 as
+ * in the Coords, baseline points 1-2 from tesseract) so that the kernel is a
+ * loop without branches that the compiler can vectorize.
+ */
+struct LineArrays {
+  std::vector<double> c0x, c0y, c1x, c1y, c2x, c2y, c3x, c3y;
+  std::vector<double> b1x, b1y, b2x, b2y;
+};
+
+inline void clearLineArrays( LineArrays& g ) {
+  for ( std::vector<double>* v : { &g.c0x, &g.c0y, &g.c1x, &g.c1y, &g.c2x, &g.c2y, &g.c3x, &g.c3y, &g.b1x, &g.b1y, &g.b2x, &g.b2y } )
+    v->clear();
+}
+
+inline void addLineArrays( LineArrays& g, const double corners[8], double x1, double y1, double x2, double y2 ) {
+  g.c0x.push_back( corners[0] ); g.c0y.push_back( corners[1] );
+  g.c1x.push_back( corners[2] ); g.c1y.push_back( corners[3] );
+  g.c2x.push_back( corners[4] ); g.c2y.push_back( corners[5] );
+  g.c3x.push_back( corners[6] ); g.c3y.push_back( corners[7] );
+  g.b1x.push_back( x1 ); g.b1y.push_back( y1 );
+  g.b2x.push_back( x2 ); g.b2y.push_back( y2 );
+}
+
+/**
+ * Intersects the baselines with the left and right sides of the boxes, and
+ * computes the polystripe height and offset, as PageXML::intersection and the
+ * norms to the corners would do for each line. Computed in double as the
+ * norms were. Defined in line-geometry.cc, which is compiled with
+ * -fno-math-errno -fno-trapping-math so that the loop vectorizes.
+ *
+ * @param g        Line coordinates.
+ * @param p1x-p2y  Baseline end points.
+ * @param height   Polystripe heights, zero if any of the intersections does not exist.
+ * @param offset   Polystripe offsets.
+ */
+void lineGeometryKernel( const LineArrays& g, double* __restrict__ p1x, double* __restrict__ p1y, double* __restrict__ p2x, double* __restrict__ p2y, double* __restrict__ height, double* __restrict__ offset );
+
+#endif
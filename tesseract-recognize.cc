@@ -16,16 +16,48 @@ using std::string;
 #include <set>
 #include <sstream>
 #include <iterator>
+#include <fstream>
 #include <getopt.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <ctime>
+#include <map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <sys/inotify.h>
+#include <cstdarg>
+#include <memory>
 
 #include <../leptonica/allheaders.h>
 #include <../tesseract/baseapi.h>
 
 #include "PageXML.h"
+#include "line-geometry.h"
+
+#ifdef __TESSREC_LIBARCHIVE__
+#include <archive.h>
+#include <archive_entry.h>
+#else
+struct archive;
+#endif
 
 /*** Definitions **************************************************************/
 static char tool[] = "tesseract-recognize";
 static char version[] = "Version: 2024.04.16";
+static char tool_info[128];
 
 char gb_page_ns[] = "http://schema.primaresearch.org/PAGE/gts/pagecontent/2013-07-15";
 
@@ -39,12 +71,43 @@ char *gb_tessdata = NULL;
 int gb_psm = tesseract::PSM_AUTO;
 int gb_oem = tesseract::OEM_DEFAULT;
 bool gb_onlylayout = false;
+bool gb_text_blocks = false;
+bool gb_nontext_regions = false;
+char *gb_extra_langs = NULL;
+std::vector< std::pair<std::string,tesseract::TessBaseAPI*> > gb_extra_apis;
+std::vector<tesseract::TessBaseAPI*> gb_worker_apis;
 bool gb_textlevels[] = { false, false, false, false };
 bool gb_textatlayout = true;
 char *gb_xpath = gb_default_xpath;
 char *gb_image = NULL;
 int gb_density = 300;
 bool gb_inplace = false;
+char *gb_output_dir = NULL;
+char *gb_output_archive = NULL;
+std::vector<std::string> gb_include;
+std::vector<std::string> gb_exclude;
+char *gb_watch = NULL;
+char *gb_watch_done = NULL;
+char *gb_watch_failed = NULL;
+char *gb_manifest = NULL;
+char *gb_progress = NULL;
+int gb_shard_index = -1;
+int gb_shard_count = 0;
+bool gb_shard_by_size = false;
+char *gb_queue = NULL;
+char *gb_text = NULL;
+char *gb_tsv = NULL;
+char *gb_alto = NULL;
+char *gb_hocr = NULL;
+char *gb_glyphs = NULL;
+char *gb_summary = NULL;
+bool gb_log_json = false;
+char *gb_request_id = NULL;
+int gb_log_repeat = -1;
+int gb_alternatives = 0;
+int gb_threads = 1;
+bool gb_xml = true;
+int gb_queue_stale = 600;
 
 bool gb_save_crops = false;
 
@@ -71,6 +134,54 @@ inline static int parseLevel( const char* level ) {
 }
 
 int gb_layoutlevel = LEVEL_LINE;
+double gb_min_conf = 0.0;
+int gb_min_conf_level = LEVEL_WORD;
+bool gb_min_conf_flag = false;
+
+/// Speed profiles as tesseract variables, applied before the ones given with --set ///
+struct ProfileVariable {
+  const char* profile;
+  const char* name;
+  const char* value;
+};
+const ProfileVariable profileVariables[] = {
+  { "fast",     "load_system_dawg",           "0" },
+  { "fast",     "load_freq_dawg",             "0" },
+  { "fast",     "load_unambig_dawg",          "0" },
+  { "fast",     "load_bigram_dawg",           "0" },
+  { "fast",     "load_number_dawg",           "0" },
+  { "fast",     "textord_tabfind_find_tables", "0" },
+  { "fast",     "classify_enable_learning",   "0" },
+  { "fast",     "tessedit_enable_doc_dict",   "0" },
+  { "balanced", "classify_enable_learning",   "0" },
+  { "balanced", "tessedit_enable_doc_dict",   "0" } };
+const char* profileStrings[] = { "fast", "balanced", "accurate" };
+inline static int parseProfile( const char* profile ) {
+  int profiles = sizeof(profileStrings) / sizeof(profileStrings[0]);
+  for( int n=0; n<profiles; n++ )
+    if( ! strcmp(profileStrings[n],profile) )
+      return n;
+  return -1;
+}
+
+/// When to clear the state learned by the adaptive classifier ///
+enum {
+  RESET_NEVER = 0,
+  RESET_DOCUMENT,
+  RESET_PAGE
+};
+const char* resetStrings[] = { "never", "document", "page" };
+inline static int parseReset( const char* reset ) {
+  int resets = sizeof(resetStrings) / sizeof(resetStrings[0]);
+  for( int n=0; n<resets; n++ )
+    if( ! strcmp(resetStrings[n],reset) )
+      return n;
+  return -1;
+}
+
+int gb_adaptive_reset = RESET_NEVER;
+char *gb_profile = NULL;
+std::vector< std::pair<std::string,std::string> > gb_vars;
 
 enum {
   OPTION_OUTPUT      = 'o',
@@ -81,13 +192,47 @@ enum {
   OPTION_LAYOUTLEVEL      ,
   OPTION_TEXTLEVELS       ,
   OPTION_ONLYLAYOUT       ,
+  OPTION_TEXTBLOCKS       ,
+  OPTION_NONTEXTREGIONS   ,
+  OPTION_EXTRALANGS       ,
+  OPTION_MINCONF          ,
+  OPTION_MINCONFLEVEL     ,
+  OPTION_MINCONFFLAG      ,
   OPTION_SAVECROPS        ,
   OPTION_XPATH            ,
   OPTION_IMAGE            ,
   OPTION_DENSITY          ,
   OPTION_PSM              ,
   OPTION_OEM              ,
-  OPTION_INPLACE
+  OPTION_INPLACE          ,
+  OPTION_OUTPUTDIR        ,
+  OPTION_OUTPUTARCHIVE    ,
+  OPTION_INCLUDE          ,
+  OPTION_EXCLUDE          ,
+  OPTION_WATCH            ,
+  OPTION_WATCHDONE        ,
+  OPTION_WATCHFAILED      ,
+  OPTION_MANIFEST         ,
+  OPTION_SHARD            ,
+  OPTION_SHARDBY          ,
+  OPTION_PROGRESS         ,
+  OPTION_QUEUE            ,
+  OPTION_QUEUESTALE       ,
+  OPTION_TEXT             ,
+  OPTION_TSV              ,
+  OPTION_ALTO             ,
+  OPTION_HOCR             ,
+  OPTION_GLYPHS           ,
+  OPTION_SUMMARY          ,
+  OPTION_LOGJSON          ,
+  OPTION_REQUESTID        ,
+  OPTION_LOGREPEAT        ,
+  OPTION_ALTERNATIVES     ,
+  OPTION_PROFILE          ,
+  OPTION_SET              ,
+  OPTION_ADAPTIVERESET    ,
+  OPTION_NOXML            ,
+  OPTION_THREADS
 };
 
 static char gb_short_options[] = "o:hv";
@@ -103,36 +248,208 @@ static struct option gb_long_options[] = {
     { "layout-level", required_argument, NULL, OPTION_LAYOUTLEVEL },
     { "text-levels",  required_argument, NULL, OPTION_TEXTLEVELS },
     { "only-layout",  no_argument,       NULL, OPTION_ONLYLAYOUT },
+    { "text-blocks",  no_argument,       NULL, OPTION_TEXTBLOCKS },
+    { "nontext-regions", no_argument,    NULL, OPTION_NONTEXTREGIONS },
+    { "extra-langs",  required_argument, NULL, OPTION_EXTRALANGS },
+    { "min-conf",     required_argument, NULL, OPTION_MINCONF },
+    { "min-conf-level", required_argument, NULL, OPTION_MINCONFLEVEL },
+    { "min-conf-flag", no_argument,      NULL, OPTION_MINCONFFLAG },
     { "save-crops",   no_argument,       NULL, OPTION_SAVECROPS },
     { "xpath",        required_argument, NULL, OPTION_XPATH },
     { "image",        required_argument, NULL, OPTION_IMAGE },
     { "density",      required_argument, NULL, OPTION_DENSITY },
     { "inplace",      no_argument,       NULL, OPTION_INPLACE },
+    { "output-dir",   required_argument, NULL, OPTION_OUTPUTDIR },
+    { "output-archive", required_argument, NULL, OPTION_OUTPUTARCHIVE },
+    { "include",      required_argument, NULL, OPTION_INCLUDE },
+    { "exclude",      required_argument, NULL, OPTION_EXCLUDE },
+    { "watch",        required_argument, NULL, OPTION_WATCH },
+    { "watch-done",   required_argument, NULL, OPTION_WATCHDONE },
+    { "watch-failed", required_argument, NULL, OPTION_WATCHFAILED },
+    { "manifest",     required_argument, NULL, OPTION_MANIFEST },
+    { "shard",        required_argument, NULL, OPTION_SHARD },
+    { "shard-by",     required_argument, NULL, OPTION_SHARDBY },
+    { "progress",     required_argument, NULL, OPTION_PROGRESS },
+    { "queue",        required_argument, NULL, OPTION_QUEUE },
+    { "queue-stale",  required_argument, NULL, OPTION_QUEUESTALE },
+    { "text",         required_argument, NULL, OPTION_TEXT },
+    { "tsv",          required_argument, NULL, OPTION_TSV },
+    { "alto",         required_argument, NULL, OPTION_ALTO },
+    { "hocr",         required_argument, NULL, OPTION_HOCR },
+    { "glyphs",       required_argument, NULL, OPTION_GLYPHS },
+    { "summary",      required_argument, NULL, OPTION_SUMMARY },
+    { "log-json",     no_argument,       NULL, OPTION_LOGJSON },
+    { "request-id",   required_argument, NULL, OPTION_REQUESTID },
+    { "log-repeat",   required_argument, NULL, OPTION_LOGREPEAT },
+    { "alternatives", required_argument, NULL, OPTION_ALTERNATIVES },
+    { "profile",      required_argument, NULL, OPTION_PROFILE },
+    { "set",          required_argument, NULL, OPTION_SET },
+    { "adaptive-reset", required_argument, NULL, OPTION_ADAPTIVERESET },
+    { "no-xml",       no_argument,       NULL, OPTION_NOXML },
+    { "threads",      required_argument, NULL, OPTION_THREADS },
     { 0, 0, 0, 0 }
   };
 
 /*** Functions ****************************************************************/
 #define strbool( cond ) ( ( cond ) ? "true" : "false" )
 
+/**
+ * Calls a function when going out of scope, so that releases happen on every return path.
+ */
+struct ScopeExit {
+  std::function<void()> func;
+  ScopeExit( std::function<void()> func ) : func(func) {}
+  ~ScopeExit() { func(); }
+};
+
+std::string jsonEscape( const std::string& str );
+
+/// Logging context and counts of warnings per call site for rate limiting ///
+std::mutex log_mutex;
+std::string log_document;
+thread_local int log_page = 0;
+std::map<const char*,int> log_repeats;
+
+void logWrite( const char* level, const char* msg, const char* extra = NULL ) {
+  if ( ! gb_log_json ) {
+    if ( ! strcmp(level,"info") )
+      fprintf( stderr, "%s: %s\n", tool, msg );
+    else
+      fprintf( stderr, "%s: %s: %s\n", tool, level, msg );
+    return;
+  }
+  char stamp[32];
+  time_t now = time(NULL);
+  struct tm tm;
+  strftime( stamp, sizeof stamp, "%Y-%m-%dT%H:%M:%SZ", gmtime_r( &now, &tm ) );
+  std::string record = std::string("{\"time\":\"") + stamp + "\",\"level\":\"" + level + "\",\"tool\":\"" + tool + "\"";
+  if ( gb_request_id != NULL )
+    record += ",\"request_id\":\"" + jsonEscape(gb_request_id) + "\"";
+  if ( ! log_document.empty() )
+    record += ",\"document\":\"" + jsonEscape(log_document) + "\"";
+  if ( log_page > 0 )
+    record += ",\"page\":" + std::to_string(log_page);
+  if ( extra != NULL )
+    record += std::string(",") + extra;
+  record += ",\"msg\":\"" + jsonEscape(msg) + "\"}\n";
+  fputs( record.c_str(), stderr );
+}
+
+void logMessage( const char* level, const char* fmt, va_list args ) {
+  char msg[4096];
+  vsnprintf( msg, sizeof msg, fmt, args );
+  std::lock_guard<std::mutex> lock(log_mutex);
+  if ( ! strcmp(level,"warning") && gb_log_repeat > 0 && ++log_repeats[fmt] > gb_log_repeat )
+    return;
+  logWrite( level, msg );
+}
+
+void logError( const char* fmt, ... ) {
+  va_list args;
+  va_start( args, fmt );
+  logMessage( "error", fmt, args );
+  va_end( args );
+}
+
+void logWarning( const char* fmt, ... ) {
+  va_list args;
+  va_start( args, fmt );
+  logMessage( "warning", fmt, args );
+  va_end( args );
+}
+
+void logInfo( const char* fmt, ... ) {
+  va_list args;
+  va_start( args, fmt );
+  logMessage( "info", fmt, args );
+  va_end( args );
+}
+
+/**
+ * Sets the document and page included in the log records. When the document
+ * changes, the number of suppressed repeated warnings of the previous one are logged.
+ */
+void logContext( const std::string& document, int page ) {
+  std::lock_guard<std::mutex> lock(log_mutex);
+  if ( document != log_document ) {
+    for ( auto& repeat : log_repeats )
+      if ( repeat.second > gb_log_repeat ) {
+        std::string msg = "suppressed " + std::to_string(repeat.second-gb_log_repeat) + " repetitions of warning: " + repeat.first;
+        logWrite( "warning", msg.c_str() );
+      }
+    log_repeats.clear();
+    log_document = document;
+  }
+  log_page = page;
+}
+
+/**
+ * Logs the outcome of a page, only for JSON logs.
+ */
+void logPage( const char* outcome, double time_ms ) {
+  if ( ! gb_log_json )
+    return;
+  char extra[96];
+  snprintf( extra, sizeof extra, "\"outcome\":\"%s\",\"time_ms\":%.1f", outcome, time_ms );
+  std::lock_guard<std::mutex> lock(log_mutex);
+  logWrite( "info", "page processed", extra );
+}
+
 void print_usage() {
   fprintf( stderr, "Description: Layout analysis and OCR using tesseract providing results in Page XML format\n" );
-  fprintf( stderr, "Usage: %s [OPTIONS] (IMAGE+|PDF+|PAGEXML)\n", tool );
+  fprintf( stderr, "Usage: %s [OPTIONS] (IMAGE+|PDF+|shm:NAME+|ARCHIVE+|DIR+|PAGEXML)\n", tool );
   fprintf( stderr, "Options:\n" );
   fprintf( stderr, " --lang LANG             Language used for OCR (def.=%s)\n", gb_lang );
+  fprintf( stderr, " --extra-langs L1[,L2]+  Also recognize the lines found with LANG using these languages\n" );
   fprintf( stderr, " --tessdata PATH         Location of tessdata (def.=%s)\n", gb_tessdata );
   fprintf( stderr, " --psm MODE              Page segmentation mode (def.=%d)\n", gb_psm );
 #if TESSERACT_VERSION >= 0x040000
   fprintf( stderr, " --oem MODE              OCR engine mode (def.=%d)\n", gb_oem );
 #endif
+  fprintf( stderr, " --profile PROFILE       Speed profile: fast, balanced, accurate (def.=tesseract defaults)\n" );
+  fprintf( stderr, " --set VAR=VALUE         Set a tesseract variable, overrides profile, can be repeated\n" );
+  fprintf( stderr, " --adaptive-reset WHEN   Clear adaptive classifier: never, document, page (def.=%s)\n", resetStrings[gb_adaptive_reset] );
+  fprintf( stderr, " --threads N             Pages of a document recognized in parallel, each worker with its own tesseract (def.=%d)\n", gb_threads );
   fprintf( stderr, " --layout-level LEVEL    Layout output level: region, line, word, glyph (def.=%s)\n", levelStrings[gb_layoutlevel] );
   fprintf( stderr, " --text-levels L1[,L2]+  Text output level(s): region, line, word, glyph (def.=layout-level)\n" );
   fprintf( stderr, " --only-layout           Only perform layout analysis, no OCR (def.=%s)\n", strbool(gb_onlylayout) );
+  fprintf( stderr, " --min-conf CONF         Drop elements with confidence below CONF in [0,1] (def.=%g)\n", gb_min_conf );
+  fprintf( stderr, " --min-conf-level LEVEL  Level to which --min-conf applies: line, word (def.=%s)\n", levelStrings[gb_min_conf_level] );
+  fprintf( stderr, " --min-conf-flag         Instead of dropping, add a low-confidence property (def.=%s)\n", strbool(gb_min_conf_flag) );
+  fprintf( stderr, " --text-blocks           Layout analysis first and then recognize only the text blocks (def.=%s)\n", strbool(gb_text_blocks) );
+  fprintf( stderr, " --nontext-regions       Add image and separator blocks as ImageRegion and SeparatorRegion (def.=%s)\n", strbool(gb_nontext_regions) );
   fprintf( stderr, " --save-crops            Saves cropped images (def.=%s)\n", strbool(gb_save_crops) );
   fprintf( stderr, " --xpath XPATH           xpath for selecting elements to process (def.=%s)\n", gb_xpath );
   fprintf( stderr, " --image IMAGE           Use given image instead of one in Page XML\n" );
   fprintf( stderr, " --density DENSITY       Density in dpi for pdf rendering (def.=%d)\n", gb_density );
+  fprintf( stderr, " --include GLOB          Files to include for directory inputs, can be repeated (def.=supported formats)\n" );
+  fprintf( stderr, " --exclude GLOB          Files or directories to exclude for directory inputs, can be repeated\n" );
+  fprintf( stderr, " --manifest FILE         File listing inputs, one per line\n" );
+  fprintf( stderr, " --shard I/N             Only process shard I (0-based) of N, requires --output-dir\n" );
+  fprintf( stderr, " --shard-by MODE         How to split inputs in shards: hash or size (def.=%s)\n", gb_shard_by_size ? "size" : "hash" );
+  fprintf( stderr, " --progress FILE         Record done inputs in FILE and skip them when rerun (def.=OUTDIR/shard_I_of_N.progress if sharded)\n" );
+  fprintf( stderr, " --queue SPOOL           Worker taking jobs from a spool directory, requires --output-dir\n" );
+  fprintf( stderr, " --queue-stale SECONDS   Time without heartbeat for a running job to be reclaimed (def.=%d)\n", gb_queue_stale );
+  fprintf( stderr, " --watch DIR             Keep running processing files written to DIR, requires --output-dir\n" );
+  fprintf( stderr, " --watch-done DIR        Where to move successfully processed watched files (def.=WATCH/done)\n" );
+  fprintf( stderr, " --watch-failed DIR      Where to move watched files that failed (def.=WATCH/failed)\n" );
   fprintf( stderr, " --inplace               Overwrite input XML with result (def.=%s)\n", strbool(gb_inplace) );
   fprintf( stderr, " -o, --output            Output page xml file (def.=%s)\n", gb_output );
+  fprintf( stderr, " --text FILE             Also write plain text, if FILE starts with '.' output extension replaced by it\n" );
+  fprintf( stderr, " --tsv FILE              Also write TSV with page, level, id, bounding box, conf and text\n" );
+  fprintf( stderr, " --alto FILE             Also write ALTO v4 xml\n" );
+  fprintf( stderr, " --hocr FILE             Also write hOCR html\n" );
+  fprintf( stderr, " --glyphs FILE           Also write binary glyph sidecar indexed by word id, requires layout level word or glyph\n" );
+  fprintf( stderr, " --summary FILE          Also write JSON with counts, confidences and times of the document\n" );
+  fprintf( stderr, " --alternatives K        Top recognition alternatives per glyph in the xml and the sidecar (def.=%d)\n", gb_alternatives );
+  fprintf( stderr, " --no-xml                Do not build nor write page xml, only the other outputs (def.=%s)\n", strbool(!gb_xml) );
+  fprintf( stderr, " --output-dir DIR        Write one page xml per input or archive member in DIR\n" );
+#ifdef __TESSREC_LIBARCHIVE__
+  fprintf( stderr, " --output-archive FILE   Write one page xml per input or archive member to a tar/zip\n" );
+#endif
+  fprintf( stderr, " --log-json              Log to stderr as JSON records, one per line, including per page outcomes (def.=%s)\n", strbool(gb_log_json) );
+  fprintf( stderr, " --request-id ID         Identifier included in the log records for correlation\n" );
+  fprintf( stderr, " --log-repeat N          Repetitions of a warning logged per document before suppressing it, 0 for no limit (def.=10 with --log-json, otherwise 0)\n" );
   fprintf( stderr, " -h, --help              Print this usage information and exit\n" );
   fprintf( stderr, " -v, --version           Print version and exit\n" );
   fprintf( stderr, "\n" );
@@ -147,13 +464,143 @@ void print_usage() {
   fprintf( stderr, "  %s -o out.xml in1.png in2.png  ### Multiple images as input\n", tool );
   fprintf( stderr, "  %s -o out.xml in.tiff  ### TIFF possibly with multiple frames\n", tool );
   fprintf( stderr, "  %s -o out.xml --density 200 in.pdf\n", tool );
+  fprintf( stderr, "  %s -o out.xml shm:/page1 shm:/page2  ### Decoded images in POSIX shared memory\n", tool );
+#ifdef __TESSREC_LIBARCHIVE__
+  fprintf( stderr, "  %s --output-archive out.zip in.tar  ### Page xml for each image in a tar archive\n", tool );
+#endif
+  fprintf( stderr, "  %s --output-dir out --exclude 'tmp*' in_dir  ### Page xml for each file found recursively in a directory\n", tool );
+  fprintf( stderr, "  %s --output-dir out --manifest list.txt --shard 3/50  ### Fourth of 50 nodes processing a batch\n", tool );
+  fprintf( stderr, "  %s --output-dir out --queue /nfs/spool  ### One of many workers sharing a spool directory\n", tool );
+  fprintf( stderr, "  %s --output-dir out --watch scans  ### Daemon processing files as they are written to scans/\n", tool );
   fprintf( stderr, "  %s -o out.xml --xpath //_:Page in.xml  ### Empty page xml recognize the complete pages\n", tool );
+  fprintf( stderr, "  %s -o out.xml --text .txt --tsv .tsv in.png  ### Also out.txt and out.tsv from the same recognition\n", tool );
+  fprintf( stderr, "  %s -o out.xml --alto .alto.xml --hocr .html in.png  ### Also ALTO and hOCR from the same recognition\n", tool );
+  fprintf( stderr, "  %s -o out.xml --layout-level word --glyphs .glyphs --alternatives 3 in.png  ### Glyphs only in binary sidecar\n", tool );
   fprintf( stderr, "  %s -o out.xml --psm 1 in.png  ### Detect page orientation pages\n", tool );
   fprintf( stderr, "  %s -o out.xml --xpath \"//_:TextRegion[@id='r1']\" --layout-level word --only-layout in.xml  ### Detect text lines and words only in TextRegion with id=r1\n", tool );
 }
 
 
-void setCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem, int x, int y, tesseract::Orientation orientation = tesseract::ORIENTATION_PAGE_UP ) {
+/**
+ * Formats points as in a points attribute if all coordinates are integers,
+ * without printf nor locale.
+ *
+ * @param points  Points to format.
+ * @param str     String where to write.
+ * @return        Whether the points were integer and formatted.
+ */
+bool formatIntPoints( const std::vector<cv::Point2f>& points, std::string& str ) {
+  char buf[24];
+  str.clear();
+  for ( size_t n=0; n<points.size(); n++ ) {
+    float coord[2] = { points[n].x, points[n].y };
+    for ( int c=0; c<2; c++ ) {
+      if ( ! ( std::fabs(coord[c]) < 1e9f ) || coord[c] != (float)(int)coord[c] )
+        return false;
+      int v = (int)coord[c];
+      unsigned u = v < 0 ? 0u-(unsigned)v : (unsigned)v;
+      char* end = buf + sizeof(buf);
+      char* p = end;
+      do {
+        *--p = (char)( '0' + u%10 );
+        u /= 10;
+      } while ( u > 0 );
+      if ( v < 0 )
+        *--p = '-';
+      if ( n > 0 || c > 0 )
+        str += c == 0 ? ' ' : ',';
+      str.append( p, end-p );
+    }
+  }
+  return true;
+}
+
+/**
+ * Parses a points attribute with a fast path for integer coordinates, falling
+ * back to PageXML::stringToPoints for anything else.
+ */
+std::vector<cv::Point2f> parsePoints( const char* spoints ) {
+  std::vector<cv::Point2f> points;
+  const char* p = spoints;
+  while ( true ) {
+    while ( *p == ' ' )
+      p++;
+    if ( *p == '\0' )
+      return points;
+    int coord[2];
+    for ( int c=0; c<2; c++ ) {
+      bool neg = *p == '-';
+      if ( neg )
+        p++;
+      if ( *p < '0' || *p > '9' )
+        return PageXML::stringToPoints( spoints );
+      int v = 0;
+      int digits = 0;
+      while ( *p >= '0' && *p <= '9' && digits++ < 9 )
+        v = 10*v + ( *p++ - '0' );
+      coord[c] = neg ? -v : v;
+      if ( c == 0 && *p++ != ',' )
+        return PageXML::stringToPoints( spoints );
+    }
+    if ( *p != ' ' && *p != '\0' )
+      return PageXML::stringToPoints( spoints );
+    points.push_back( cv::Point2f( coord[0], coord[1] ) );
+  }
+}
+
+/**
+ * Gets the points of the Coords of an element, like PageXML::getPoints but
+ * without an xpath query.
+ */
+std::vector<cv::Point2f> getCoordsPoints( PageXML& page, const xmlNodePtr node ) {
+  for ( xmlNodePtr child = node->children; child != NULL; child = child->next )
+    if ( child->type == XML_ELEMENT_NODE && xmlStrEqual( child->name, BAD_CAST "Coords" ) ) {
+      xmlChar* spoints = xmlGetProp( child, BAD_CAST "points" );
+      if ( spoints == NULL )
+        break;
+      std::vector<cv::Point2f> points = parsePoints( (const char*)spoints );
+      xmlFree( spoints );
+      return points;
+    }
+  return page.getPoints( node );
+}
+
+/**
+ * Sets the Coords of an element. For new elements, i.e. without children, and
+ * integer non-degenerate quadrilaterals, the element is added directly with
+ * the fast formatter, otherwise it is done by PageXML::setCoords.
+ */
+xmlNodePtr setCoordsFast( PageXML& page, xmlNodePtr node, const std::vector<cv::Point2f>& points ) {
+  std::string spoints;
+  if ( node->children != NULL || points.size() != 4 || ! formatIntPoints( points, spoints ) )
+    return page.setCoords( node, points );
+  float area = 0;
+  for ( int n=0; n<4; n++ )
+    area += points[n].x*points[(n+1)%4].y - points[(n+1)%4].x*points[n].y;
+  if ( area == 0 )
+    return page.setCoords( node, points );
+  xmlNodePtr coords = page.addElem( "Coords", NULL, node );
+  page.setAttr( coords, "points", spoints.c_str() );
+  return coords;
+}
+
+/**
+ * Sets the Baseline of an element that has Coords and no Baseline with the
+ * fast formatter if integer, otherwise it is done by PageXML::setBaseline.
+ */
+xmlNodePtr setBaselineFast( PageXML& page, xmlNodePtr node, const std::vector<cv::Point2f>& points ) {
+  std::string spoints;
+  xmlNodePtr coords = xmlFirstElementChild( node );
+  if ( coords == NULL || ! xmlStrEqual( coords->name, BAD_CAST "Coords" ) ||
+       ( xmlNextElementSibling( coords ) != NULL && xmlStrEqual( xmlNextElementSibling( coords )->name, BAD_CAST "Baseline" ) ) ||
+       ! formatIntPoints( points, spoints ) )
+    return page.setBaseline( node, points );
+  xmlNodePtr baseline = page.addElem( "Baseline", NULL, coords, PAGEXML_INSERT_NEXTSIB );
+  page.setAttr( baseline, "points", spoints.c_str() );
+  return baseline;
+}
+
+std::vector<cv::Point2f> getCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem, int x, int y, tesseract::Orientation orientation = tesseract::ORIENTATION_PAGE_UP ) {
   int left, top, right, bottom;
   int pagenum = page.getPageNumber(xelem);
   iter->BoundingBox( iter_level, &left, &top, &right, &bottom );
@@ -172,633 +619,1312 @@ void setCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel it
       case tesseract::ORIENTATION_PAGE_DOWN:  points = { br, bl, tl, tr }; break;
     }
   }
-  page.setCoords( xelem, points );
+  return points;
+}
+
+void setCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem, int x, int y, tesseract::Orientation orientation = tesseract::ORIENTATION_PAGE_UP ) {
+  setCoordsFast( page, xelem, getCoords( iter, iter_level, page, xelem, x, y, orientation ) );
+}
+
+/**
+ * Lines of a page whose baselines and polystripes are computed in a batch after the walk.
+ */
+struct LineGeometry : LineArrays {
+  std::vector<xmlNodePtr> nodes;
+};
+
+void clearLineGeometry( LineGeometry& g ) {
+  g.nodes.clear();
+  clearLineArrays( g );
+}
+
+/**
+ * Sets the baselines and polystripes of the lines of a page and clears the batch.
+ */
+void setLineGeometries( PageXML& page, LineGeometry& g ) {
+  const int num = (int)g.nodes.size();
+  std::vector<double> out( 6*num );
+  double* p1x = out.data();
+  double* p1y = p1x + num;
+  double* p2x = p1y + num;
+  double* p2y = p2x + num;
+  double* height = p2y + num;
+  double* offset = height + num;
+  lineGeometryKernel( g, p1x, p1y, p2x, p2y, height, offset );
+
+  for ( int i=0; i<num; i++ ) {
+    if ( height[i] == 0.0 ) {
+      std::string lid = page.getAttr( g.nodes[i], "id" );
+      if ( gb_log_json )
+        logWarning( "no intersection between baseline and bounding box sides id=%s", lid.c_str() );
+      else
+        fprintf(stderr,"warning: no intersection between baseline and bounding box sides id=%s\n",lid.c_str());
+      std::vector<cv::Point2f> baseline = {
+        cv::Point2f(g.b1x[i],g.b1y[i]),
+        cv::Point2f(g.b2x[i],g.b2y[i]) };
+      setBaselineFast( page, g.nodes[i], baseline );
+      continue;
+    }
+    std::vector<cv::Point2f> baseline = {
+      cv::Point2f(p1x[i],p1y[i]),
+      cv::Point2f(p2x[i],p2y[i]) };
+    setBaselineFast( page, g.nodes[i], baseline );
+    page.setPolystripe( g.nodes[i], height[i], offset[i], false );
+  }
+  clearLineGeometry( g );
 }
 
-void setLineCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem, int x, int y, tesseract::Orientation orientation ) {
-  setCoords( iter, iter_level, page, xelem, x, y, orientation );
-  std::vector<cv::Point2f> coords = page.getPoints( xelem );
+/**
+ * Sets the line coords and adds the line to the batch for the baseline and polystripe.
+ */
+void setLineCoords( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem, int x, int y, tesseract::Orientation orientation, LineGeometry& g ) {
+  std::vector<cv::Point2f> coords = getCoords( iter, iter_level, page, xelem, x, y, orientation );
+  setCoordsFast( page, xelem, coords );
   int x1, y1, x2, y2;
   iter->Baseline( iter_level, &x1, &y1, &x2, &y2 );
-  cv::Point2f b_p1(x+x1,y+y1), b_p2(x+x2,y+y2);
-  cv::Point2f baseline_p1, baseline_p2;
-  if ( ! page.intersection( b_p1, b_p2, coords[0], coords[3], baseline_p1 ) ||
-       ! page.intersection( b_p1, b_p2, coords[1], coords[2], baseline_p2 ) ) {
-    std::string lid = page.getAttr(xelem,"id");
-    fprintf(stderr,"warning: no intersection between baseline and bounding box sides id=%s\n",lid.c_str());
+
+  /// Line covering the whole page, nothing to intersect ///
+  if ( coords.size() != 4 ) {
     std::vector<cv::Point2f> baseline = {
       cv::Point2f(x+x1,y+y1),
       cv::Point2f(x+x2,y+y2) };
-    page.setBaseline( xelem, baseline );
+    setBaselineFast( page, xelem, baseline );
     return;
   }
-  std::vector<cv::Point2f> baseline = { baseline_p1, baseline_p2 };
-  page.setBaseline( xelem, baseline );
-  double up1 = cv::norm( baseline_p1 - coords[0] );
-  double up2 = cv::norm( baseline_p2 - coords[1] );
-  double down1 = cv::norm( baseline_p1 - coords[3] );
-  double down2 = cv::norm( baseline_p2 - coords[2] );
-  double height = 0.5*( up1 + up2 + down1 + down2 );
-  double offset = height <= 0.0 ? 0.0 : 0.5*( down1 + down2 ) / height;
-  page.setPolystripe( xelem, height <= 0.0 ? 1.0 : height, offset, false );
+
+  const double corners[8] = { coords[0].x, coords[0].y, coords[1].x, coords[1].y, coords[2].x, coords[2].y, coords[3].x, coords[3].y };
+  g.nodes.push_back( xelem );
+  addLineArrays( g, corners, x+x1, y+y1, x+x2, y+y2 );
 }
 
-void setTextEquiv( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem ) {
-  double conf = 0.01*iter->Confidence( iter_level );
+void getText( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, std::string& stext, double& conf ) {
+  conf = 0.01*iter->Confidence( iter_level );
   char* text = iter->GetUTF8Text( iter_level );
-  std::string stext(text);
+  stext = std::string(text);
   stext = std::regex_replace( stext, std::regex("^\\s+|\\s+$"), "$1" );
-  page.setTextEquiv( xelem, stext.c_str(), &conf );
   delete[] text;
 }
 
-template<typename Out>
-void split( const std::string &s, char delim, Out result ) {
-  std::stringstream ss(s);
-  std::string item;
-  while( std::getline(ss, item, delim) )
-    *(result++) = item;
+/**
+ * Gets the top recognition alternatives of the current symbol.
+ *
+ * @param iter   Iterator positioned at the symbol.
+ * @param k      Maximum number of alternatives.
+ * @param alts   Pairs of text and confidence, best first.
+ */
+void getAlternatives( tesseract::ResultIterator* iter, int k, std::vector< std::pair<std::string,double> >& alts ) {
+  tesseract::ChoiceIterator choice( *iter );
+  do {
+    const char* text = choice.GetUTF8Text();
+    if ( text != NULL )
+      alts.push_back( std::make_pair( std::string(text), 0.01*choice.Confidence() ) );
+  } while ( (int)alts.size() < k && choice.Next() );
 }
 
-std::set<int> parsePagesSet( std::string range ) {
-  std::set<int> pages_set;
-  std::vector<std::string> parts;
-  split( range, ',', std::back_inserter(parts) );
-  for( auto part : parts ) {
-    std::string::size_type dash_pos = part.find('-');
-    if( dash_pos == std::string::npos )
-      pages_set.insert(stoi(part));
-    else
-      for( int num=stoi(part.substr(0, dash_pos)); num<=stoi(part.substr(dash_pos+1)); num++ )
-        pages_set.insert(num);
-  }
-  return pages_set;
+/**
+ * Recognizes a text line of the image set in a tesseract instance.
+ *
+ * @param api    Tesseract instance with page segmentation mode single line.
+ * @param text   Recognized text.
+ * @param conf   Mean confidence.
+ */
+void recognizeLine( tesseract::TessBaseAPI* api, int left, int top, int right, int bottom, std::string& text, double& conf ) {
+  api->SetRectangle( left, top, right-left, bottom-top );
+  char* utf8 = api->GetUTF8Text();
+  text = utf8 == NULL ? std::string() : std::regex_replace( std::string(utf8), std::regex("^\\s+|\\s+$"), "$1" );
+  delete[] utf8;
+  conf = 0.01*api->MeanTextConf();
+}
+
+void setTextEquiv( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, PageXML& page, xmlNodePtr& xelem ) {
+  double conf;
+  std::string stext;
+  getText( iter, iter_level, stext, conf );
+  page.setTextEquiv( xelem, stext.c_str(), &conf );
 }
 
+/**
+ * Whether an element is below the minimum confidence, only for the level it applies to.
+ */
+inline static bool belowMinConf( tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, int level ) {
+  return gb_min_conf > 0.0 && level == gb_min_conf_level && ! gb_onlylayout && 0.01*iter->Confidence( iter_level ) < gb_min_conf;
+}
 
-/*** Program ******************************************************************/
-int main( int argc, char *argv[] ) {
+/**
+ * Text of a line restricted to what is kept by --min-conf.
+ */
+struct PrunedLine {
+  bool keep;
+  std::string text;
+  double conf;
+};
 
-  /// Disable debugging and informational messages from Leptonica. ///
-  setMsgSeverity(L_SEVERITY_ERROR);
+/**
+ * Walks a copy of the iterator through a block to know beforehand the lines
+ * and words dropped by --min-conf, so that the text of the lines and of the
+ * block is that of the kept words, and lines without kept words are dropped.
+ *
+ * @param block_iter  Iterator positioned at the block.
+ * @param lines       Text of each line of the block, in the order of the walk.
+ * @param text        Text of the block, lines separated by new lines and paragraphs by empty lines.
+ * @param conf        Confidence of the block, mean of the kept lines.
+ * @return            Number of dropped elements at the --min-conf level.
+ */
+int pruneBlock( const tesseract::ResultIterator* block_iter, std::vector<PrunedLine>& lines, std::string& text, double& conf ) {
+  tesseract::ResultIterator iter( *block_iter );
+  int dropped = 0;
+  lines.clear();
+  text.clear();
+  conf = 0.0;
+  while ( true ) {
+    bool para_kept = false;
+    while ( true ) {
+      PrunedLine pline = { false, "", 0.0 };
+      if ( belowMinConf( &iter, tesseract::RIL_TEXTLINE, LEVEL_LINE ) )
+        dropped++;
+      else if ( gb_min_conf_level == LEVEL_LINE ) {
+        pline.keep = true;
+        getText( &iter, tesseract::RIL_TEXTLINE, pline.text, pline.conf );
+      }
 
-  /// Parse input arguments ///
-  int n,m;
-  std::stringstream test;
-  std::string token;
-  while ( ( n = getopt_long(argc,argv,gb_short_options,gb_long_options,&m) ) != -1 )
-    switch ( n ) {
-      case OPTION_TESSDATA:
-        gb_tessdata = optarg;
-        break;
-      case OPTION_LANG:
-        gb_lang = optarg;
-        break;
-      case OPTION_PSM:
-        gb_psm = atoi(optarg);
-        if( gb_psm < tesseract::PSM_AUTO_OSD || gb_psm == tesseract::PSM_AUTO_ONLY || gb_psm >= tesseract::PSM_COUNT ) {
-          fprintf( stderr, "%s: error: invalid page segmentation mode: %s\n", tool, optarg );
-          return 1;
-        }
-        break;
-#if TESSERACT_VERSION >= 0x040000
-      case OPTION_OEM:
-        gb_oem = atoi(optarg);
-        if( gb_oem < tesseract::OEM_TESSERACT_ONLY || gb_oem >= tesseract::OEM_COUNT ) {
-          fprintf( stderr, "%s: error: invalid OCR engine mode: %s\n", tool, optarg );
-          return 1;
-        }
-        break;
-#endif
-      case OPTION_LAYOUTLEVEL:
-        gb_layoutlevel = parseLevel(optarg);
-        if( gb_layoutlevel == -1 ) {
-          fprintf( stderr, "%s: error: invalid level: %s\n", tool, optarg );
-          return 1;
-        }
-        break;
-      case OPTION_TEXTLEVELS:
-        test = std::stringstream(optarg);
-        while( std::getline(test, token, ',') ) {
-          int textlevel = parseLevel(token.c_str());
-          if( textlevel == -1 ) {
-            fprintf( stderr, "%s: error: invalid level: %s\n", tool, token.c_str() );
-            return 1;
+      /// Words of the line, the line confidence is the mean of the kept words ///
+      else {
+        int kept = 0;
+        while ( true ) {
+          if ( belowMinConf( &iter, tesseract::RIL_WORD, LEVEL_WORD ) )
+            dropped++;
+          else {
+            std::string wtext;
+            double wconf;
+            getText( &iter, tesseract::RIL_WORD, wtext, wconf );
+            pline.text += ( kept > 0 ? " " : "" ) + wtext;
+            pline.conf += wconf;
+            kept++;
           }
-          gb_textlevels[textlevel] = true;
-          gb_textatlayout = false;
+          if ( iter.IsAtFinalElement( tesseract::RIL_TEXTLINE, tesseract::RIL_WORD ) )
+            break;
+          iter.Next( tesseract::RIL_WORD );
         }
+        pline.keep = kept > 0;
+        if ( kept > 0 )
+          pline.conf /= kept;
+      }
+
+      if ( pline.keep ) {
+        text += pline.text + "\n";
+        conf += pline.conf;
+        para_kept = true;
+      }
+      lines.push_back( pline );
+      if ( iter.IsAtFinalElement( tesseract::RIL_PARA, tesseract::RIL_TEXTLINE ) )
         break;
-      case OPTION_ONLYLAYOUT:
-        gb_onlylayout = true;
-        break;
-      case OPTION_SAVECROPS:
-        gb_save_crops = true;
-        break;
-      case OPTION_XPATH:
-        gb_xpath = optarg;
-        break;
-      case OPTION_IMAGE:
-        gb_image = optarg;
-        break;
-      case OPTION_DENSITY:
-        gb_density = atoi(optarg);
-        break;
-      case OPTION_INPLACE:
-        gb_inplace = true;
-        break;
-      case OPTION_OUTPUT:
-        gb_output = optarg;
-        break;
-      case OPTION_HELP:
-        print_usage();
-        return 0;
-      case OPTION_VERSION:
-        fprintf( stderr, "%s %s\n", tool, version+9 );
-        fprintf( stderr, "compiled against PageXML %s\n", PageXML::version() );
-#ifdef TESSERACT_VERSION_STR
-        fprintf( stderr, "compiled against tesseract %s, linked with %s\n", TESSERACT_VERSION_STR, tesseract::TessBaseAPI::Version() );
-#else
-        fprintf( stderr, "linked with tesseract %s\n", tesseract::TessBaseAPI::Version() );
-#endif
-        return 0;
-      default:
-        fprintf( stderr, "%s: error: incorrect input argument: %s\n", tool, argv[optind-1] );
-        return 1;
+      iter.Next( tesseract::RIL_TEXTLINE );
     }
-
-  /// Default text level ///
-  if ( gb_textatlayout )
-    gb_textlevels[gb_layoutlevel] = true;
-
-  /// Check that there is at least one non-option argument ///
-  if ( optind >= argc ) {
-    fprintf( stderr, "%s: error: at least one input file must be provided, see usage with --help\n", tool );
-    return 1;
+    if ( para_kept )
+      text += "\n";
+    if ( iter.IsAtFinalElement( tesseract::RIL_BLOCK, tesseract::RIL_PARA ) )
+      break;
+    iter.Next( tesseract::RIL_PARA );
   }
 
-  /// Initialize tesseract just for layout or with given language and tessdata path///
-  tesseract::TessBaseAPI *tessApi = new tesseract::TessBaseAPI();
+  int kept = 0;
+  for ( auto& pline : lines )
+    kept += pline.keep ? 1 : 0;
+  if ( kept > 0 )
+    conf /= kept;
+  while ( ! text.empty() && text.back() == '\n' )
+    text.pop_back();
+  return dropped;
+}
 
-  if ( gb_onlylayout && gb_psm != tesseract::PSM_AUTO_OSD )
-    tessApi->InitForAnalysePage();
-  else
-#if TESSERACT_VERSION >= 0x040000
-  if ( tessApi->Init( gb_tessdata, gb_lang, (tesseract::OcrEngineMode)gb_oem ) ) {
-#else
-  if ( tessApi->Init( gb_tessdata, gb_lang) ) {
-#endif
-    fprintf( stderr, "%s: error: could not initialize tesseract\n", tool );
-    return 1;
-  }
+/**
+ * Element of the iterator walk as needed for the outputs written directly
+ * from it, and whose text is shared with the Page XML TextEquiv.
+ */
+struct WalkElement {
+  int level;
+  std::string id;
+  int left, top, right, bottom;
+  bool has_text;
+  std::string text;
+  double conf;
+  std::vector< std::pair<std::string,double> > alts;
+};
 
-  tessApi->SetPageSegMode( (tesseract::PageSegMode)gb_psm );
+/**
+ * Level of the plain text output, lines unless layout only down to regions.
+ */
+inline static int plainTextLevel() {
+  return gb_layoutlevel < LEVEL_LINE ? LEVEL_REGION : LEVEL_LINE;
+}
 
-  PageXML page;
-  int num_pages = 0;
-  bool pixRelease = false;
-  std::vector<NamedImage> images;
-  tesseract::ResultIterator* iter = NULL;
+void setWalkElement( WalkElement& elem, tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, int level, const std::string& id, int x, int y ) {
+  elem.level = level;
+  elem.id = id;
+  iter->BoundingBox( iter_level, &elem.left, &elem.top, &elem.right, &elem.bottom );
+  elem.left += x;
+  elem.right += x;
+  elem.top += y;
+  elem.bottom += y;
+  elem.has_text = ! gb_onlylayout && ( gb_textlevels[level] || ( gb_text != NULL && level == plainTextLevel() ) ||
+    ( ( gb_alto != NULL || gb_hocr != NULL ) && ( level == LEVEL_GLYPH || level == std::min(gb_layoutlevel,(int)LEVEL_WORD) ) ) ||
+    ( gb_glyphs != NULL && level == LEVEL_GLYPH ) );
+  if ( elem.has_text )
+    getText( iter, iter_level, elem.text, elem.conf );
+  elem.alts.clear();
+  if ( elem.has_text && level == LEVEL_GLYPH && gb_alternatives > 0 )
+    getAlternatives( iter, gb_alternatives, elem.alts );
+}
 
-  std::regex reIsXml(".+\\.xml$|^-$",std::regex_constants::icase);
-  std::regex reIsTiff(".+\\.tif{1,2}(|\\[[-, 0-9]+\\])$",std::regex_constants::icase);
-  std::regex reIsPdf(".+\\.pdf(|\\[[-, 0-9]+\\])$",std::regex_constants::icase);
-  std::regex reImagePageNum("(.+)\\[([-, 0-9]+)\\]$");
-  std::cmatch base_match;
-  char *input_file = argv[optind];
-  bool input_xml = std::regex_match(input_file,base_match,reIsXml);
-
-  /// Inplace only when XML input and output not specified ///
-  if ( gb_inplace && ( ! input_xml || strcmp(gb_output,"-") ) ) {
-    fprintf( stderr, "%s: warning: ignoring --inplace option, output to %s\n", tool, gb_output );
-    gb_inplace = false;
-  }
-
-  /// Info for process element ///
-  char tool_info[128];
-  if ( gb_onlylayout )
-    snprintf( tool_info, sizeof tool_info, "%s_v%.10s tesseract_v%s", tool, version+9, tesseract::TessBaseAPI::Version() );
-  else
-    snprintf( tool_info, sizeof tool_info, "%s_v%.10s tesseract_v%s lang=%s", tool, version+9, tesseract::TessBaseAPI::Version(), gb_lang );
-
-  /// Loop through input files ///
-  for ( ; optind < argc; optind++ ) {
-    input_file = argv[optind];
-    input_xml = std::regex_match(input_file,base_match,reIsXml);
-    bool input_tiff = std::regex_match(input_file,base_match,reIsTiff);
-    bool input_pdf = std::regex_match(input_file,base_match,reIsPdf);
-
-    /// Get selected pages for tiff/pdf if given ///
-    std::set<int> pages_set;
-    std::string page_sel;
-    std::string input_file_str = std::string(input_file);
-    if ( input_tiff || input_pdf ) {
-      if( std::regex_match(input_file, base_match, reImagePageNum) ) {
-        pages_set = parsePagesSet(base_match[2].str());
-        page_sel = std::string(base_match[2].str());
-        input_file_str = std::string(base_match[1].str());
-      }
-    }
+/**
+ * Contents of the outputs written directly from the iterator walk.
+ */
+struct DirectOutputs {
+  std::string text;
+  std::string tsv;
+  std::string alto;
+  std::string hocr;
+};
 
-    /// Input is xml ///
-    if ( input_xml ) {
-      if ( num_pages > 0 ) {
-        fprintf( stderr, "%s: error: only a single page xml allowed as input\n", tool );
-        return 1;
-      }
-      try {
-        page.loadXml( input_file ); // if input_file is "-" xml is read from stdin
-      } catch ( const std::exception& e ) {
-        fprintf( stderr, "%s: error: problems reading xml file: %s\n%s\n", tool, input_file, e.what() );
-        return 1;
-      }
-      if ( gb_image != NULL ) {
-        if ( page.count("//_:Page") > 1 ) {
-          fprintf( stderr, "%s: error: specifying image with multipage xml input not supported\n", tool );
-          return 1;
+std::string jsonEscape( const std::string& str ) {
+  std::string esc;
+  esc.reserve( str.size() );
+  for ( char c : str )
+    switch ( c ) {
+      case '"':  esc += "\\\"";  break;
+      case '\\': esc += "\\\\"; break;
+      case '\n': esc += "\\n";  break;
+      case '\t': esc += "\\t";  break;
+      default:
+        if ( (unsigned char)c < 0x20 ) {
+          char buf[8];
+          snprintf( buf, sizeof buf, "\\u%04x", c );
+          esc += buf;
         }
-        page.loadImage( 0, gb_image );
-      }
-      num_pages += page.count("//_:Page");
-
-      if ( gb_psm == tesseract::PSM_AUTO_OSD && page.count("//_:ImageOrientation") > 0 ) {
-        fprintf( stderr, "%s: error: refusing to use OSD on page xml that already contains ImageOrientation elements\n", tool );
-        return 1;
-      }
-
-      std::vector<xmlNodePtr> sel = page.select(gb_xpath);
-      int selPages = 0;
-      for ( n=0; n<(int)sel.size(); n++ )
-        if ( page.nodeIs( sel[n], "Page" ) )
-          selPages++;
-      if ( selPages > 0 && selPages != (int)sel.size() ) {
-        fprintf( stderr, "%s: error: xpath can select Page or non-Page elements but not a mixture of both: %s\n", tool, gb_xpath );
-        return 1;
-      }
+        else
+          esc += c;
+    }
+  return esc;
+}
 
-      if ( selPages == 0 ) {
-        pixRelease = true;
-        images = page.crop( (std::string(gb_xpath)+"/_:Coords").c_str(), NULL, false );
-        page.releaseImages();
-      }
-      else {
-        for ( n=0; n<(int)sel.size(); n++ ) {
-          NamedImage namedimage;
-          namedimage.image = NULL;
-          namedimage.node = sel[n];
-          images.push_back( namedimage );
-          num_pages++;
-        }
-      }
+std::string xmlEscape( const std::string& str ) {
+  std::string esc;
+  esc.reserve( str.size() );
+  for ( char c : str )
+    switch ( c ) {
+      case '&':  esc += "&amp;";  break;
+      case '<':  esc += "&lt;";   break;
+      case '>':  esc += "&gt;";   break;
+      case '"':  esc += "&quot;"; break;
+      case '\'': esc += "&apos;"; break;
+      default:   esc += c;
     }
+  return esc;
+}
 
-    /// Input is tiff image ///
-    else if ( input_tiff ) {
-      pixRelease = true;
+const char* altoElems[] = { "TextBlock", "TextLine", "String", "Glyph" };
+const char* hocrClasses[] = { "ocr_carea", "ocr_line", "ocrx_word", "ocrx_cinfo" };
 
-      /// Read input image ///
-      PIXA* tiffimage = pixaReadMultipageTiff( input_file_str.c_str() );
-      if ( tiffimage == NULL || tiffimage->n == 0 ) {
-        fprintf( stderr, "%s: error: problems reading tiff image: %s\n", tool, input_file );
-        return 1;
-      }
+std::string altoHeader( const std::string& image ) {
+  return std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n") +
+    "<alto xmlns=\"http://www.loc.gov/standards/alto/ns-v4#\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" " +
+    "xsi:schemaLocation=\"http://www.loc.gov/standards/alto/ns-v4# http://www.loc.gov/alto/v4/alto-4-2.xsd\">\n" +
+    "<Description>\n<MeasurementUnit>pixel</MeasurementUnit>\n" +
+    "<sourceImageInformation>\n<fileName>" + xmlEscape(image) + "</fileName>\n</sourceImageInformation>\n" +
+    "<Processing ID=\"OCR_0\">\n<processingSoftware>\n<softwareName>" + xmlEscape(tool_info) + "</softwareName>\n</processingSoftware>\n</Processing>\n" +
+    "</Description>\n<Layout>\n";
+}
 
-      if ( pages_set.size() > 0 && tiffimage->n <= *pages_set.rbegin() ) {
-        fprintf( stderr, "%s: error: invalid page selection (%s) on tiff with %d pages\n", tool, page_sel.c_str(), tiffimage->n+1 );
-        return 1;
-      }
+std::string hocrHeader() {
+  return std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n") +
+    "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" \"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n" +
+    "<html xmlns=\"http://www.w3.org/1999/xhtml\" xml:lang=\"en\" lang=\"en\">\n<head>\n<title></title>\n" +
+    "<meta http-equiv=\"Content-Type\" content=\"text/html;charset=utf-8\"/>\n" +
+    "<meta name=\"ocr-system\" content=\"" + xmlEscape(tool_info) + "\"/>\n" +
+    "<meta name=\"ocr-capabilities\" content=\"ocr_page ocr_carea ocr_line ocrx_word ocrx_cinfo\"/>\n" +
+    "</head>\n<body>\n";
+}
 
-      for ( n=0; n<tiffimage->n; n++ ) {
-        if ( pages_set.size() > 0 && pages_set.find(n) == pages_set.end() )
-          continue;
+void directPageBegin( DirectOutputs& outs, int pagenum, const std::string& image, int width, int height ) {
+  char buf[256];
+  if ( gb_alto != NULL ) {
+    snprintf( buf, sizeof buf, "<Page ID=\"page_%d\" PHYSICAL_IMG_NR=\"%d\" WIDTH=\"%d\" HEIGHT=\"%d\">\n"
+      "<PrintSpace HPOS=\"0\" VPOS=\"0\" WIDTH=\"%d\" HEIGHT=\"%d\">\n", pagenum, pagenum, width, height, width, height );
+    outs.alto += buf;
+  }
+  if ( gb_hocr != NULL ) {
+    outs.hocr += "<div class=\"ocr_page\" id=\"page_" + std::to_string(pagenum) + "\" title=\"image &quot;" + xmlEscape(image);
+    snprintf( buf, sizeof buf, "&quot;; bbox 0 0 %d %d; ppageno %d\">\n", width, height, pagenum-1 );
+    outs.hocr += buf;
+  }
+}
 
-        PageImage image = pixClone(tiffimage->pix[n]);
-        std::string pagepath = input_file_str+"["+std::to_string(n)+"]";
-        NamedImage namedimage;
-        namedimage.image = image;
-        if ( num_pages == 0 )
-          namedimage.node = page.newXml( tool_info, pagepath.c_str(), pixGetWidth(image), pixGetHeight(image), gb_page_ns );
-        else
-          namedimage.node = page.addPage( pagepath.c_str(), pixGetWidth(image), pixGetHeight(image) );
-        images.push_back( namedimage );
-        num_pages++;
-      }
+void directPageEnd( DirectOutputs& outs ) {
+  if ( gb_text != NULL )
+    outs.text += "\f";
+  if ( gb_alto != NULL )
+    outs.alto += "</PrintSpace>\n</Page>\n";
+  if ( gb_hocr != NULL )
+    outs.hocr += "</div>\n";
+}
 
-      pixaDestroy(&tiffimage);
+void directElement( DirectOutputs& outs, int pagenum, const WalkElement& elem ) {
+  if ( gb_tsv != NULL ) {
+    char row[96];
+    snprintf( row, sizeof row, "%d\t%s\t", pagenum, levelStrings[elem.level] );
+    outs.tsv += row + elem.id;
+    snprintf( row, sizeof row, "\t%d\t%d\t%d\t%d\t", elem.left, elem.top, elem.right-elem.left, elem.bottom-elem.top );
+    outs.tsv += row;
+    if ( elem.has_text && gb_textlevels[elem.level] ) {
+      snprintf( row, sizeof row, "%.4g\t", elem.conf );
+      outs.tsv += row;
+      for ( char c : elem.text )
+        outs.tsv += c == '\t' || c == '\n' || c == '\r' ? ' ' : c;
     }
+    else
+      outs.tsv += "\t";
+    outs.tsv += "\n";
+  }
+  if ( gb_text != NULL ) {
+    if ( elem.level == LEVEL_REGION && ! outs.text.empty() && outs.text.back() != '\f' )
+      outs.text += "\n";
+    if ( elem.level == plainTextLevel() && elem.has_text )
+      outs.text += elem.text + "\n";
+  }
 
-    /// Input is pdf ///
-    else if ( input_pdf ) {
-      std::vector< std::pair<double,double> > pdf_pages = gsGetPdfPageSizes(input_file_str);
-      if ( pages_set.size() > 0 && (int)pdf_pages.size() <= *pages_set.rbegin() ) {
-        fprintf( stderr, "%s: error: invalid page selection (%s) on pdf with %d pages\n", tool, page_sel.c_str(), (int)pdf_pages.size() );
-        return 1;
-      }
-
-      for ( n=0; n<(int)pdf_pages.size(); n++ ) {
-        if ( pages_set.size() > 0 && pages_set.find(n) == pages_set.end() )
-          continue;
-
-        std::string pagepath = input_file_str+"["+std::to_string(n)+"]";
-        NamedImage namedimage;
-        namedimage.image = NULL;
-        if ( num_pages == 0 )
-          namedimage.node = page.newXml( tool_info, pagepath.c_str(), (int)(0.5+pdf_pages[n].first), (int)(0.5+pdf_pages[n].second), gb_page_ns );
-        else
-          namedimage.node = page.addPage( pagepath.c_str(), (int)(0.5+pdf_pages[n].first), (int)(0.5+pdf_pages[n].second) );
-        images.push_back( namedimage );
-        num_pages++;
-      }
+  /// Structured formats, elements at the layout level are leaves except ALTO lines that require a String ///
+  bool leaf = elem.level >= gb_layoutlevel;
+  char buf[128];
+  if ( gb_alto != NULL ) {
+    snprintf( buf, sizeof buf, " HPOS=\"%d\" VPOS=\"%d\" WIDTH=\"%d\" HEIGHT=\"%d\"", elem.left, elem.top, elem.right-elem.left, elem.bottom-elem.top );
+    std::string box = buf;
+    std::string content = " CONTENT=\"\""; // required in String and Glyph even without text
+    if ( elem.has_text ) {
+      snprintf( buf, sizeof buf, " %s=\"%.4g\"", elem.level == LEVEL_GLYPH ? "GC" : "WC", elem.conf );
+      content = std::string(buf) + " CONTENT=\"" + xmlEscape(elem.text) + "\"";
     }
-
-    /// Input is image ///
-    else {
-      /// Read input image ///
-      PageImage image = pixRead( input_file );
-      if ( image == NULL ) {
-        fprintf( stderr, "%s: error: problems reading image: %s\n", tool, input_file );
-        return 1;
-      }
-
-      NamedImage namedimage;
-      namedimage.image = NULL;
-      if ( num_pages == 0 )
-        namedimage.node = page.newXml( tool_info, input_file, pixGetWidth(image), pixGetHeight(image), gb_page_ns );
-      else
-        namedimage.node = page.addPage( input_file, pixGetWidth(image), pixGetHeight(image) );
-      num_pages++;
-      pixDestroy(&image);
-      images.push_back( namedimage );
+    std::string id = xmlEscape(elem.id);
+    outs.alto += std::string("<") + altoElems[elem.level] + " ID=\"" + id + "\"" + box;
+    if ( elem.level == LEVEL_LINE && leaf )
+      outs.alto += ">\n<String ID=\"" + id + "_s\"" + box + content + "/>\n";
+    else
+      outs.alto += ( elem.level >= LEVEL_WORD ? content : "" ) + ( leaf ? "/>\n" : ">\n" );
+  }
+  if ( gb_hocr != NULL ) {
+    snprintf( buf, sizeof buf, "\" title=\"bbox %d %d %d %d", elem.left, elem.top, elem.right, elem.bottom );
+    outs.hocr += std::string("<") + ( elem.level == LEVEL_REGION ? "div" : "span" ) + " class=\"" + hocrClasses[elem.level] + "\" id=\"" + xmlEscape(elem.id) + buf;
+    if ( elem.has_text && elem.level >= LEVEL_WORD ) {
+      snprintf( buf, sizeof buf, elem.level == LEVEL_WORD ? "; x_wconf %.0f" : "; x_conf %.2f", 100*elem.conf );
+      outs.hocr += buf;
     }
+    outs.hocr += "\">";
+    if ( leaf )
+      outs.hocr += ( elem.has_text ? xmlEscape(elem.text) : "" ) + ( elem.level == LEVEL_REGION ? "</div>\n" : "</span>\n" );
+    else if ( elem.level < LEVEL_WORD )
+      outs.hocr += "\n";
   }
+}
 
-  page.processStart(tool_info);
-
-  /// Loop through all images to process ///
-  for ( n=0; n<(int)images.size(); n++ ) {
-    xmlNodePtr xpg = page.closest( "Page", images[n].node );
+void directElementEnd( DirectOutputs& outs, const WalkElement& elem ) {
+  bool leaf = elem.level >= gb_layoutlevel;
+  if ( gb_alto != NULL && ( ! leaf || elem.level == LEVEL_LINE ) )
+    outs.alto += std::string("</") + altoElems[elem.level] + ">\n";
+  if ( gb_hocr != NULL && ! leaf )
+    outs.hocr += elem.level == LEVEL_REGION ? "</div>\n" : "</span>\n";
+}
 
-    if ( images[n].image == NULL ) {
-      try {
-        page.loadImage(xpg, NULL, true, gb_density );
-        images[n].image = page.getPageImage(n);
-      } catch ( const std::exception& e ) {
-        fprintf( stderr, "%s: error: problems loading page image: %s :: %s\n", tool, page.getPageImageFilename(n).c_str(), e.what() );
-        return 1;
-      }
-    }
+/**
+ * Words whose box tesseract does not know, i.e. the whole image, held back
+ * with the direct outputs of their glyphs until the following word is known.
+ */
+typedef std::vector< std::pair<WalkElement,DirectOutputs> > UnboxedWords;
 
-    tessApi->SetImage( images[n].image );
-    if ( gb_save_crops && input_xml ) {
-      std::string fout = std::string("crop_")+std::to_string(n)+"_"+images[n].id+".png";
-      fprintf( stderr, "%s: writing cropped image: %s\n", tool, fout.c_str() );
-      pixWriteImpliedFormat( fout.c_str(), images[n].image, 0, 0 );
+/**
+ * Fills in the boxes of the held back words as done for the "0,0 0,0" Word
+ * Coords of the Page XML, and writes them and their glyphs to the outputs.
+ * From the last word backwards, the box spans from the preceding word to the
+ * following one, is one pixel wide next to only one of them, or is the box
+ * of the line if there is neither. A filled word is the following of the
+ * word before it.
+ *
+ * @param outs    The direct outputs.
+ * @param pagenum Page number.
+ * @param words   The held back words, cleared at the end.
+ * @param prev    The preceding word with a known box, or NULL.
+ * @param next    The following word with a known box, or NULL at the end of the line.
+ * @param line    The line of the words.
+ */
+void directUnboxedWords( DirectOutputs& outs, int pagenum, UnboxedWords& words, const WalkElement* prev, const WalkElement* next, const WalkElement& line ) {
+  const WalkElement* fol = next;
+  for ( int n=(int)words.size()-1; n>=0; n-- ) {
+    WalkElement& elem = words[n].first;
+    if ( prev != NULL && fol != NULL ) {
+      elem.left = std::min( prev->right, fol->left );
+      elem.right = std::max( prev->right, fol->left );
+      elem.top = std::min( prev->top, fol->top );
+      elem.bottom = std::max( prev->bottom, fol->bottom );
     }
-
-    /// For xml input setup node level ///
-    xmlNodePtr node = NULL;
-    int node_level = -1;
-    if ( input_xml ) {
-      node = images[n].node->parent;
-      if ( page.nodeIs( node, "TextRegion" ) )
-        node_level = LEVEL_REGION;
-      else if ( page.nodeIs( node, "TextLine" ) ) {
-        node_level = LEVEL_LINE;
-        if ( gb_psm != tesseract::PSM_SINGLE_LINE && gb_psm != tesseract::PSM_RAW_LINE ) {
-          fprintf( stderr, "%s: error: for xml input selecting text lines, valid page segmentation modes are %d and %d\n", tool, tesseract::PSM_SINGLE_LINE, tesseract::PSM_RAW_LINE );
-          return 1;
-        }
-      }
-      else if ( page.nodeIs( node, "Word" ) ) {
-        node_level = LEVEL_WORD;
-        if ( gb_psm != tesseract::PSM_SINGLE_WORD && gb_psm != tesseract::PSM_CIRCLE_WORD ) {
-          fprintf( stderr, "%s: error: for xml input selecting words, valid page segmentation modes are %d and %d\n", tool, tesseract::PSM_SINGLE_WORD, tesseract::PSM_CIRCLE_WORD );
-          return 1;
-        }
-      }
-      else if ( page.nodeIs( node, "Glyph" ) ) {
-        node_level = LEVEL_GLYPH;
-        if ( gb_psm != tesseract::PSM_SINGLE_CHAR ) {
-          fprintf( stderr, "%s: error: for xml input selecting glyphs, the only valid page segmentation mode is %d\n", tool, tesseract::PSM_SINGLE_CHAR );
-          return 1;
-        }
-      }
-      if ( gb_layoutlevel < node_level ) {
-        fprintf( stderr, "%s: error: layout level lower than xpath selection level\n", tool );
-        return 1;
-      }
+    else if ( prev != NULL || fol != NULL ) {
+      elem.left = prev != NULL ? prev->right : fol->left-1;
+      elem.right = elem.left+1;
+      elem.top = prev != NULL ? prev->top : fol->top;
+      elem.bottom = prev != NULL ? prev->bottom : fol->bottom;
     }
-
-    /// Perform layout analysis ///
-    if ( gb_onlylayout && gb_psm != tesseract::PSM_AUTO_OSD )
-      iter = (tesseract::ResultIterator*)( tessApi->AnalyseLayout() );
-
-    /// Perform recognition ///
     else {
-      tessApi->Recognize( 0 );
-      iter = tessApi->GetIterator();
+      elem.left = line.left;
+      elem.right = line.right;
+      elem.top = line.top;
+      elem.bottom = line.bottom;
     }
+    fol = &elem;
+  }
+  for ( auto& word : words ) {
+    directElement( outs, pagenum, word.first );
+    outs.text += word.second.text;
+    outs.tsv += word.second.tsv;
+    outs.alto += word.second.alto;
+    outs.hocr += word.second.hocr;
+  }
+  words.clear();
+}
 
-    if ( iter != NULL && ! iter->Empty( tesseract::RIL_BLOCK ) ) {
-      /// Orientation and Script Detection ///
-      tesseract::Orientation orientation;
-      tesseract::WritingDirection writing_direction;
-      tesseract::TextlineOrder textline_order;
-      float deskew_angle;
-      iter->Orientation( &orientation, &writing_direction, &textline_order, &deskew_angle );
+/// Binary glyph sidecar: header, words sorted by id, glyphs, alternatives and a string pool.
+/// All fields are native-endian 32 bit so that the file can be mmap'ed and used in place.
+/// Offsets of strings are relative to the start of the string pool. ///
+struct GlyphsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_words;
+  uint32_t num_glyphs;
+  uint32_t num_alts;
+  uint32_t strings_size;
+  uint32_t reserved;
+};
 
-      if ( gb_psm == tesseract::PSM_AUTO_OSD ) {
-        if ( deskew_angle != 0.0 )
-          page.setProperty( xpg, "deskewAngle", deskew_angle );
-        switch ( orientation ) {
-          case tesseract::ORIENTATION_PAGE_RIGHT:          page.setProperty( xpg, "apply-image-orientation", -90 );      break;
-          case tesseract::ORIENTATION_PAGE_LEFT:           page.setProperty( xpg, "apply-image-orientation", 90 );       break;
-          case tesseract::ORIENTATION_PAGE_DOWN:           page.setProperty( xpg, "apply-image-orientation", 180 );      break;
-          default: break;
-        }
-        switch ( writing_direction ) {
-          case tesseract::WRITING_DIRECTION_LEFT_TO_RIGHT: page.setProperty( xpg, "readingDirection", "left-to-right" ); break;
-          case tesseract::WRITING_DIRECTION_RIGHT_TO_LEFT: page.setProperty( xpg, "readingDirection", "right-to-left" ); break;
-          case tesseract::WRITING_DIRECTION_TOP_TO_BOTTOM: page.setProperty( xpg, "readingDirection", "top-to-bottom" ); break;
-        }
-        switch ( textline_order ) {
-          case tesseract::TEXTLINE_ORDER_LEFT_TO_RIGHT:    page.setProperty( xpg, "textLineOrder", "left-to-right" );    break;
-          case tesseract::TEXTLINE_ORDER_RIGHT_TO_LEFT:    page.setProperty( xpg, "textLineOrder", "right-to-left" );    break;
-          case tesseract::TEXTLINE_ORDER_TOP_TO_BOTTOM:    page.setProperty( xpg, "textLineOrder", "top-to-bottom" );    break;
-        }
-      }
+struct GlyphsWord {
+  uint32_t id_offset;
+  uint32_t id_length;
+  uint32_t page;
+  uint32_t first_glyph;
+  uint32_t num_glyphs;
+};
 
-      /// Loop through blocks ///
-      int block = 0;
-      while ( gb_layoutlevel >= LEVEL_REGION ) {
-        /// Skip non-text blocks ///
-        /*
-         0 PT_UNKNOWN,        // Type is not yet known. Keep as the first element.
-         1 PT_FLOWING_TEXT,   // Text that lives inside a column.
-         2 PT_HEADING_TEXT,   // Text that spans more than one column.
-         3 PT_PULLOUT_TEXT,   // Text that is in a cross-column pull-out region.
-         4 PT_EQUATION,       // Partition belonging to an equation region.
-         5 PT_INLINE_EQUATION,  // Partition has inline equation.
-         6 PT_TABLE,          // Partition belonging to a table region.
-         7 PT_VERTICAL_TEXT,  // Text-line runs vertically.
-         8 PT_CAPTION_TEXT,   // Text that belongs to an image.
-         9 PT_FLOWING_IMAGE,  // Image that lives inside a column.
-         10 PT_HEADING_IMAGE,  // Image that spans more than one column.
-         11 PT_PULLOUT_IMAGE,  // Image that is in a cross-column pull-out region.
-         12 PT_HORZ_LINE,      // Horizontal Line.
-         13 PT_VERT_LINE,      // Vertical Line.
-         14 PT_NOISE,          // Lies outside of any column.
-        */
-        if ( iter->BlockType() > PT_CAPTION_TEXT ) {
-          if ( ! iter->Next( tesseract::RIL_BLOCK ) )
-            break;
-          continue;
-        }
+struct GlyphsGlyph {
+  int32_t left, top, right, bottom;
+  float conf;
+  uint32_t text_offset;
+  uint32_t text_length;
+  uint32_t first_alt;
+  uint32_t num_alts;
+};
 
-        block++;
+struct GlyphsAlt {
+  uint32_t text_offset;
+  uint32_t text_length;
+  float conf;
+};
 
-        xmlNodePtr xreg = NULL;
-        std::string rid = "b" + std::to_string(block);
+struct GlyphSidecar {
+  std::vector<GlyphsWord> words;
+  std::vector<GlyphsGlyph> glyphs;
+  std::vector<GlyphsAlt> alts;
+  std::string strings;
+};
 
-        /// If xml input and region selected, prepend id to rid and set xreg to node ///
-        if ( node_level == LEVEL_REGION ) {
-          rid = std::string(images[n].id) + "_" + rid;
-          xreg = node;
-        }
+void sidecarString( GlyphSidecar& sc, const std::string& str, uint32_t& offset, uint32_t& length ) {
+  offset = (uint32_t)sc.strings.size();
+  length = (uint32_t)str.size();
+  sc.strings += str;
+}
 
-        /// If it is multipage, prepend page number to rid ///
-        if ( num_pages > 1 )
-          rid = std::string("pg") + std::to_string(1+page.getPageNumber(xpg)) + "_" + rid;
+void sidecarWord( GlyphSidecar& sc, int pagenum, const std::string& id ) {
+  GlyphsWord w;
+  sidecarString( sc, id, w.id_offset, w.id_length );
+  w.page = (uint32_t)pagenum;
+  w.first_glyph = (uint32_t)sc.glyphs.size();
+  w.num_glyphs = 0;
+  sc.words.push_back( w );
+}
 
-        /// Otherwise add block as TextRegion element ///
-        if ( node_level < LEVEL_REGION ) {
-          xreg = page.addTextRegion( xpg, rid.c_str() );
+/**
+ * Appends the current symbol of the iterator to the last word of the sidecar.
+ *
+ * @param sc     The sidecar being built.
+ * @param elem   Walk element of the symbol, with page coordinates, text and alternatives.
+ */
+void sidecarGlyph( GlyphSidecar& sc, const WalkElement& elem ) {
+  GlyphsGlyph g;
+  g.left = elem.left;
+  g.top = elem.top;
+  g.right = elem.right;
+  g.bottom = elem.bottom;
+  g.conf = elem.has_text ? (float)elem.conf : -1.0f;
+  sidecarString( sc, elem.has_text ? elem.text : std::string(), g.text_offset, g.text_length );
+  g.first_alt = (uint32_t)sc.alts.size();
+  g.num_alts = (uint32_t)elem.alts.size();
+  for ( auto& alt : elem.alts ) {
+    GlyphsAlt a;
+    sidecarString( sc, alt.first, a.text_offset, a.text_length );
+    a.conf = (float)alt.second;
+    sc.alts.push_back( a );
+  }
+  sc.glyphs.push_back( g );
+  sc.words.back().num_glyphs++;
+}
 
-          /// Set block bounding box and text ///
-          setCoords( iter, tesseract::RIL_BLOCK, page, xreg, images[n].x, images[n].y );
-          if ( ! gb_onlylayout && gb_textlevels[LEVEL_REGION] )
-            setTextEquiv( iter, tesseract::RIL_BLOCK, page, xreg );
-        }
+/**
+ * Appends a sidecar to another one, as if its words had been added after.
+ */
+void sidecarAppend( GlyphSidecar& sc, const GlyphSidecar& other ) {
+  uint32_t strings = (uint32_t)sc.strings.size();
+  uint32_t glyphs = (uint32_t)sc.glyphs.size();
+  uint32_t alts = (uint32_t)sc.alts.size();
+  for ( GlyphsWord w : other.words ) {
+    w.id_offset += strings;
+    w.first_glyph += glyphs;
+    sc.words.push_back( w );
+  }
+  for ( GlyphsGlyph g : other.glyphs ) {
+    g.text_offset += strings;
+    g.first_alt += alts;
+    sc.glyphs.push_back( g );
+  }
+  for ( GlyphsAlt a : other.alts ) {
+    a.text_offset += strings;
+    sc.alts.push_back( a );
+  }
+  sc.strings += other.strings;
+}
 
-        /// Set rotation and reading direction ///
-        /*tesseract::Orientation orientation;
-        tesseract::WritingDirection writing_direction;
-        tesseract::TextlineOrder textline_order;
-        float deskew_angle;*/
-        iter->Orientation( &orientation, &writing_direction, &textline_order, &deskew_angle );
-        if ( ! input_xml || node_level <= LEVEL_REGION ) {
-          if ( deskew_angle != 0.0 )
-            page.setProperty( xpg, "deskewAngle", deskew_angle );
-          PAGEXML_READ_DIRECTION direct = PAGEXML_READ_DIRECTION_LTR;
-          switch( writing_direction ) {
-            case tesseract::WRITING_DIRECTION_LEFT_TO_RIGHT: direct = PAGEXML_READ_DIRECTION_LTR; break;
-            case tesseract::WRITING_DIRECTION_RIGHT_TO_LEFT: direct = PAGEXML_READ_DIRECTION_RTL; break;
-            case tesseract::WRITING_DIRECTION_TOP_TO_BOTTOM: direct = PAGEXML_READ_DIRECTION_TTB; break;
-          }
-          page.setReadingDirection( xreg, direct );
-          /*float orient = 0.0;
-          switch( orientation ) {
-            case tesseract::ORIENTATION_PAGE_UP:    orient = 0.0;   break;
-            case tesseract::ORIENTATION_PAGE_RIGHT: orient = -90.0; break;
-            case tesseract::ORIENTATION_PAGE_LEFT:  orient = 90.0;  break;
-            case tesseract::ORIENTATION_PAGE_DOWN:  orient = 180.0; break;
-          }
-          page.setRotation( xreg, orient );*/
-        }
+std::string sidecarSerialize( GlyphSidecar& sc ) {
+  std::sort( sc.words.begin(), sc.words.end(), [&sc]( const GlyphsWord& a, const GlyphsWord& b ) {
+      return sc.strings.compare( a.id_offset, a.id_length, sc.strings, b.id_offset, b.id_length ) < 0;
+    } );
+  GlyphsHeader h;
+  memcpy( h.magic, "TRGLYPHS", sizeof h.magic );
+  h.version = 1;
+  h.num_words = (uint32_t)sc.words.size();
+  h.num_glyphs = (uint32_t)sc.glyphs.size();
+  h.num_alts = (uint32_t)sc.alts.size();
+  h.strings_size = (uint32_t)sc.strings.size();
+  h.reserved = 0;
+  std::string bin;
+  bin.reserve( sizeof h + sc.words.size()*sizeof(GlyphsWord) + sc.glyphs.size()*sizeof(GlyphsGlyph) + sc.alts.size()*sizeof(GlyphsAlt) + sc.strings.size() );
+  bin.append( (const char*)&h, sizeof h );
+  bin.append( (const char*)sc.words.data(), sc.words.size()*sizeof(GlyphsWord) );
+  bin.append( (const char*)sc.glyphs.data(), sc.glyphs.size()*sizeof(GlyphsGlyph) );
+  bin.append( (const char*)sc.alts.data(), sc.alts.size()*sizeof(GlyphsAlt) );
+  bin += sc.strings;
+  return bin;
+}
 
-        /// Loop through paragraphs in current block ///
-        int para = 0;
-        while ( gb_layoutlevel >= LEVEL_REGION ) {
-          para++;
+/**
+ * Statistics of a document accumulated during the walk.
+ */
+struct PageSummary {
+  int page;
+  int regions, lines, words, glyphs;
+  double time_ms;
+};
 
-          /// Loop through lines in current paragraph ///
-          int line = 0;
-          while ( gb_layoutlevel >= LEVEL_LINE ) {
-            line++;
+struct DocumentSummary {
+  std::vector<PageSummary> pages;
+  std::vector<float> confs;
+};
 
-            xmlNodePtr xline = NULL;
+void summaryPage( DocumentSummary& sum, int pagenum ) {
+  PageSummary p;
+  p.page = pagenum;
+  p.regions = p.lines = p.words = p.glyphs = 0;
+  p.time_ms = 0.0;
+  sum.pages.push_back( p );
+}
 
-            /// If xml input and line selected, set xline to node ///
-            if ( node_level == LEVEL_LINE )
-              xline = node;
+/**
+ * Counts an element of the walk, recording its confidence if at the deepest level down to words.
+ */
+void summaryElement( DocumentSummary& sum, tesseract::ResultIterator* iter, tesseract::PageIteratorLevel iter_level, int level ) {
+  PageSummary& p = sum.pages.back();
+  switch ( level ) {
+    case LEVEL_REGION: p.regions++; break;
+    case LEVEL_LINE:   p.lines++;   break;
+    case LEVEL_WORD:   p.words++;   break;
+    case LEVEL_GLYPH:  p.glyphs++;  break;
+  }
+  if ( ! gb_onlylayout && level == std::min(gb_layoutlevel,(int)LEVEL_WORD) )
+    sum.confs.push_back( 0.01f*iter->Confidence( iter_level ) );
+}
 
-            /// Otherwise add TextLine element ///
-            else if ( node_level < LEVEL_LINE ) {
-              std::string lid = rid + "_p" + std::to_string(para) + "_l" + std::to_string(line);
-              xline = page.addTextLine( xreg, lid.c_str() );
-            }
+std::string summaryJson( DocumentSummary& sum, const std::string& document ) {
+  int regions = 0, lines = 0, words = 0, glyphs = 0, blank = 0;
+  double time_ms = 0.0, max_ms = 0.0;
+  std::string per_page;
+  char buf[256];
+  for ( auto& p : sum.pages ) {
+    regions += p.regions;
+    lines += p.lines;
+    words += p.words;
+    glyphs += p.glyphs;
+    blank += p.regions == 0;
+    time_ms += p.time_ms;
+    max_ms = std::max( max_ms, p.time_ms );
+    snprintf( buf, sizeof buf, "%s\n    { \"page\": %d, \"regions\": %d, \"lines\": %d, \"words\": %d, \"glyphs\": %d, \"blank\": %s, \"time_ms\": %.1f }",
+      per_page.empty() ? "" : ",", p.page, p.regions, p.lines, p.words, p.glyphs, strbool(p.regions == 0), p.time_ms );
+    per_page += buf;
+  }
 
-            /// Set line bounding box, baseline and text ///
-            if ( xline != NULL ) {
-              setLineCoords( iter, tesseract::RIL_TEXTLINE, page, xline, images[n].x, images[n].y, orientation );
-              if ( ! gb_onlylayout && gb_textlevels[LEVEL_LINE] )
-                setTextEquiv( iter, tesseract::RIL_TEXTLINE, page, xline );
-            }
+  std::string json = "{\n  \"document\": \"" + jsonEscape(document) + "\",\n";
+  snprintf( buf, sizeof buf, "  \"pages\": %d,\n  \"blank_pages\": %d,\n  \"regions\": %d,\n  \"lines\": %d,\n  \"words\": %d,\n  \"glyphs\": %d,\n",
+    (int)sum.pages.size(), blank, regions, lines, words, glyphs );
+  json += buf;
+  if ( ! sum.confs.empty() ) {
+    std::sort( sum.confs.begin(), sum.confs.end() );
+    double mean = 0.0;
+    for ( float conf : sum.confs )
+      mean += conf;
+    mean /= sum.confs.size();
+    size_t last = sum.confs.size()-1;
+    snprintf( buf, sizeof buf, "  \"conf\": { \"level\": \"%s\", \"count\": %d, \"mean\": %.4f, \"p10\": %.4f, \"p50\": %.4f, \"p90\": %.4f },\n",
+      levelStrings[std::min(gb_layoutlevel,(int)LEVEL_WORD)], (int)sum.confs.size(), mean, sum.confs[last/10], sum.confs[last/2], sum.confs[last*9/10] );
+    json += buf;
+  }
+  snprintf( buf, sizeof buf, "  \"time_ms\": { \"total\": %.1f, \"mean\": %.1f, \"max\": %.1f },\n",
+    time_ms, sum.pages.empty() ? 0.0 : time_ms/sum.pages.size(), max_ms );
+  json += buf;
+  json += "  \"per_page\": [" + per_page + "\n  ]\n}\n";
+  return json;
+}
 
-            /// Loop through words in current text line ///
-            while ( gb_layoutlevel >= LEVEL_WORD ) {
-              xmlNodePtr xword = NULL;
+/**
+ * Path of an additional output, either given or if it starts with a dot, the output path with extension replaced.
+ */
+std::string formatPath( const char* format_output, const std::string& output ) {
+  if ( format_output[0] != '.' )
+    return std::string(format_output);
+  return std::regex_replace( output, std::regex("\\.[^./]*$"), "" ) + format_output;
+}
 
-              /// If xml input and word selected, set xword to node ///
-              if ( node_level == LEVEL_WORD )
-                xword = node;
+/**
+ * Writes a string to a file or to stdout if fname is "-".
+ */
+bool writeFile( const std::string& fname, const std::string& content ) {
+  FILE* file = fname == "-" ? stdout : fopen( fname.c_str(), "wb" );
+  if ( file == NULL )
+    return false;
+  bool ok = fwrite( content.data(), 1, content.size(), file ) == content.size();
+  if ( file != stdout )
+    ok = fclose( file ) == 0 && ok;
+  else
+    fflush( file );
+  return ok;
+}
 
-              /// Otherwise add Word element ///
-              else if ( node_level < LEVEL_WORD )
-                xword = page.addWord( xline );
+template<typename Out>
+void split( const std::string &s, char delim, Out result ) {
+  std::stringstream ss(s);
+  std::string item;
+  while( std::getline(ss, item, delim) )
+    *(result++) = item;
+}
 
-              /// Set word bounding box and text ///
-              if ( xword != NULL ) {
-                setCoords( iter, tesseract::RIL_WORD, page, xword, images[n].x, images[n].y, orientation );
-                if ( ! gb_onlylayout && gb_textlevels[LEVEL_WORD] )
-                  setTextEquiv( iter, tesseract::RIL_WORD, page, xword );
-              }
+/**
+ * Header of a decoded page image placed in POSIX shared memory by a caller. It
+ * is followed at data_offset bytes from the start of the segment by height rows
+ * of stride bytes. The rows must be in leptonica's 32-bit word order, which is
+ * indicated by SHM_FLAG_NATIVE, or plain bytes in memory order on big-endian
+ * hosts where both are the same, so that the pixels are used without copying.
+ */
+#define SHM_MAGIC "TRSHMv1"
+#define SHM_FLAG_NATIVE 0x1
 
-              /// Loop through symbols in current word ///
-              while ( gb_layoutlevel >= LEVEL_GLYPH ) {
-                /// Set xglyph to node or add new Glyph element depending on the case ///
-                xmlNodePtr xglyph = node_level == LEVEL_GLYPH ? node : page.addGlyph( xword );
+struct ShmPageHeader {
+  char magic[8];
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  uint32_t stride;
+  uint32_t flags;
+  uint32_t xres;
+  uint32_t yres;
+  uint32_t data_offset;
+};
 
-                /// Set symbol bounding box and text ///
-                setCoords( iter, tesseract::RIL_SYMBOL, page, xglyph, images[n].x, images[n].y, orientation );
-                if ( ! gb_onlylayout && gb_textlevels[LEVEL_GLYPH] )
-                  setTextEquiv( iter, tesseract::RIL_SYMBOL, page, xglyph );
+struct ShmImage {
+  PageImage image;
+  void* addr;
+  size_t size;
+};
 
-                if ( iter->IsAtFinalElement( tesseract::RIL_WORD, tesseract::RIL_SYMBOL ) )
-                  break;
-                iter->Next( tesseract::RIL_SYMBOL );
-              } // while ( gb_layoutlevel >= LEVEL_GLYPH ) {
+PageImage shmOpenImage( const char* name, ShmImage& shm ) {
+  shm.image = NULL;
+  shm.addr = NULL;
+  shm.size = 0;
 
-              if ( iter->IsAtFinalElement( tesseract::RIL_TEXTLINE, tesseract::RIL_WORD ) )
-                break;
-              iter->Next( tesseract::RIL_WORD );
-            } // while ( gb_layoutlevel >= LEVEL_WORD ) {
+  int fd = shm_open( name, O_RDONLY, 0 );
+  if ( fd < 0 ) {
+    logError( "unable to open shared memory segment: %s", name );
+    return NULL;
+  }
+  struct stat st;
+  if ( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof(ShmPageHeader) ) {
+    logError( "shared memory segment too small: %s", name );
+    close( fd );
+    return NULL;
+  }
 
-            if ( iter->IsAtFinalElement( tesseract::RIL_PARA, tesseract::RIL_TEXTLINE ) )
-              break;
-            iter->Next( tesseract::RIL_TEXTLINE );
-          } // while ( gb_layoutlevel >= LEVEL_LINE ) {
+  /// Read-only mapping, the pixels are never modified ///
+  void* addr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if ( addr == MAP_FAILED ) {
+    logError( "unable to map shared memory segment: %s", name );
+    return NULL;
+  }
 
-          if ( iter->IsAtFinalElement( tesseract::RIL_BLOCK, tesseract::RIL_PARA ) )
-            break;
-          iter->Next( tesseract::RIL_PARA );
-        } // while ( gb_layoutlevel >= LEVEL_REGION ) {
+  const ShmPageHeader* head = (const ShmPageHeader*)addr;
+  size_t data_size = (size_t)head->stride * head->height;
+  if ( strncmp( head->magic, SHM_MAGIC, sizeof(head->magic) ) ||
+       ( head->depth != 1 && head->depth != 8 && head->depth != 32 ) ||
+       head->width == 0 || head->height == 0 ||
+       head->stride % 4 != 0 || (uint64_t)8*head->stride < (uint64_t)head->width*head->depth ||
+       head->data_offset % 4 != 0 || head->data_offset < sizeof(ShmPageHeader) ||
+       head->data_offset + data_size > (size_t)st.st_size ) {
+    logError( "invalid page image header in shared memory segment: %s", name );
+    munmap( addr, st.st_size );
+    return NULL;
+  }
 
-        if ( ! iter->Next( tesseract::RIL_BLOCK ) )
-          break;
-      } // while ( gb_layoutlevel >= LEVEL_REGION ) {
-    } // if ( iter != NULL && ! iter->Empty( tesseract::RIL_BLOCK ) ) {
-    page.releaseImage(xpg);
-  } // for ( n=0; n<(int)images.size(); n++ ) {
+  /// Rows in memory byte order would need a swap, i.e. a copy, on little-endian hosts ///
+  const uint32_t one = 1;
+  if ( ! ( head->flags & SHM_FLAG_NATIVE ) && *(const char*)&one == 1 ) {
+    logError( "page image in shared memory segment not in native word order (flags=1): %s", name );
+    munmap( addr, st.st_size );
+    return NULL;
+  }
+
+  /// Wrap pixels as a PIX without copying ///
+  PageImage image = pixCreateHeader( head->width, head->height, head->depth );
+  pixSetWpl( image, head->stride/4 );
+  pixSetData( image, (l_uint32*)( (char*)addr + head->data_offset ) );
+  if ( head->xres > 0 )
+    pixSetResolution( image, head->xres, head->yres > 0 ? head->yres : head->xres );
+
+  shm.image = image;
+  shm.addr = addr;
+  shm.size = st.st_size;
+  return image;
+}
+
+void shmReleaseImage( ShmImage& shm ) {
+  /// Detach data so that pixDestroy does not free the mapped memory ///
+  if ( shm.image != NULL )
+    pixSetData( shm.image, NULL );
+  if ( shm.addr != NULL )
+    munmap( shm.addr, shm.size );
+  shm.addr = NULL;
+}
+
+/**
+ * An input to process. If data is empty the input is read from the file name,
+ * otherwise the name only identifies it, e.g. for an archive member.
+ */
+struct InputFile {
+  std::string name;
+  std::vector<l_uint8> data;
+};
+
+std::set<int> parsePagesSet( std::string range ) {
+  std::set<int> pages_set;
+  std::vector<std::string> parts;
+  split( range, ',', std::back_inserter(parts) );
+  for( auto part : parts ) {
+    std::string::size_type dash_pos = part.find('-');
+    if( dash_pos == std::string::npos )
+      pages_set.insert(stoi(part));
+    else
+      for( int num=stoi(part.substr(0, dash_pos)); num<=stoi(part.substr(dash_pos+1)); num++ )
+        pages_set.insert(num);
+  }
+  return pages_set;
+}
+
+
+/**
+ * Creates a directory and all of its missing parents.
+ */
+bool makeDirs( const std::string& dir ) {
+  for ( size_t pos = dir.find('/',1); ; pos = dir.find('/',pos+1) ) {
+    std::string sub = dir.substr(0,pos);
+    if ( ! sub.empty() && mkdir( sub.c_str(), 0777 ) != 0 && errno != EEXIST )
+      return false;
+    if ( pos == std::string::npos )
+      break;
+  }
+  return true;
+}
+
+/**
+ * Lists the names of the entries of a directory, sorted, without . and .. .
+ */
+std::vector<std::string> listDirectory( const std::string& dir ) {
+  std::vector<std::string> names;
+  DIR* dp = opendir( dir.c_str() );
+  struct dirent* de;
+  while ( dp != NULL && ( de = readdir(dp) ) != NULL )
+    if ( strcmp(de->d_name,".") && strcmp(de->d_name,"..") )
+      names.push_back( de->d_name );
+  if ( dp != NULL )
+    closedir( dp );
+  std::sort( names.begin(), names.end() );
+  return names;
+}
+
+/**
+ * Moves a file, across file systems by copying it and removing the source.
+ */
+bool moveFile( const std::string& src, const std::string& dest ) {
+  if ( rename( src.c_str(), dest.c_str() ) == 0 )
+    return true;
+  if ( errno != EXDEV )
+    return false;
+  std::ifstream in( src, std::ios::binary );
+  std::ofstream out( dest, std::ios::binary | std::ios::trunc );
+  if ( ! in || ! out || ! ( out << in.rdbuf() ) || ! out.flush() ) {
+    int err = errno;
+    out.close();
+    unlink( dest.c_str() );
+    errno = err;
+    return false;
+  }
+  out.close();
+  return unlink( src.c_str() ) == 0;
+}
+
+/**
+ * Relative path of the Page XML for an input name, i.e. with extension replaced by .xml.
+ */
+std::string xmlPathFor( const std::string& name ) {
+  static const std::regex reExtension("\\.[^./]*$");
+  return std::regex_replace( name, reExtension, "" ) + ".xml";
+}
+
+/**
+ * Checks by its name whether an input is a tar or zip archive.
+ */
+bool isArchiveName( const std::string& name ) {
+  static const std::vector<std::string> extensions = { ".tar", ".tgz", ".tar.gz", ".tar.bz2", ".tar.xz", ".zip" };
+  for ( auto& ext : extensions )
+    if ( name.size() > ext.size() && std::equal( ext.begin(), ext.end(), name.end()-ext.size(), []( char e, char c ) { return e == tolower((unsigned char)c); } ) )
+      return true;
+  return false;
+}
+
+/**
+ * Checks whether a path relative to a directory input matches a glob. Globs
+ * without a slash are matched against the base name at any depth.
+ */
+bool globMatch( const std::string& glob, const std::string& relpath ) {
+  if ( glob.find('/') == std::string::npos )
+    return fnmatch( glob.c_str(), relpath.substr( relpath.rfind('/')+1 ).c_str(), 0 ) == 0;
+  return fnmatch( glob.c_str(), relpath.c_str(), FNM_PATHNAME ) == 0;
+}
+
+/**
+ * Checks whether a relative path matches any of the --exclude globs.
+ */
+bool isExcluded( const std::string& relpath ) {
+  for ( auto& glob : gb_exclude )
+    if ( globMatch( glob, relpath ) )
+      return true;
+  return false;
+}
+
+/**
+ * Checks whether a relative file path matches the --include globs or if none given is of a supported format.
+ */
+bool isIncluded( const std::string& relpath ) {
+  static const std::regex reIsSupported(".+\\.(png|jpe?g|tiff?|pdf|bmp|gif|webp|jp2|pnm|pbm|pgm|ppm)$",std::regex_constants::icase);
+  if ( gb_include.empty() )
+    return std::regex_match(relpath,reIsSupported);
+  for ( auto& glob : gb_include )
+    if ( globMatch( glob, relpath ) )
+      return true;
+  return false;
+}
+
+struct DiscoveredFile {
+  std::string path;
+  std::string relpath;
+  off_t size;
+};
+
+/**
+ * Recursively finds the images, TIFFs and PDFs in a directory. Subdirectories
+ * are scanned in parallel by a few threads sharing a queue of pending ones.
+ *
+ * @param dir  Directory to scan.
+ * @return     Found files, sorted by path.
+ */
+std::vector<DiscoveredFile> discoverFiles( const std::string& dir ) {
+  std::vector<DiscoveredFile> found;
+  std::vector<std::string> pending(1,"");
+  std::set< std::pair<dev_t,ino_t> > visited;
+  std::mutex mtx;
+  std::condition_variable cond;
+  int busy = 0;
+
+  struct stat st;
+  if ( stat( dir.c_str(), &st ) == 0 )
+    visited.insert( std::make_pair( st.st_dev, st.st_ino ) );
+
+  auto scanner = [&]() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while ( true ) {
+      cond.wait( lock, [&]{ return ! pending.empty() || busy == 0; } );
+      if ( pending.empty() )
+        break;
+      std::string reldir = pending.back();
+      pending.pop_back();
+      busy++;
+      lock.unlock();
+
+      std::vector<DiscoveredFile> files;
+      std::vector<std::string> subdirs;
+      std::string absdir = reldir.empty() ? dir : dir + "/" + reldir;
+      DIR* dp = opendir( absdir.c_str() );
+      if ( dp == NULL )
+        logWarning( "unable to read directory: %s", absdir.c_str() );
+      struct dirent* de;
+      while ( dp != NULL && ( de = readdir(dp) ) != NULL ) {
+        if ( ! strcmp(de->d_name,".") || ! strcmp(de->d_name,"..") )
+          continue;
+        DiscoveredFile file;
+        file.relpath = reldir.empty() ? de->d_name : reldir + "/" + de->d_name;
+        file.path = dir + "/" + file.relpath;
+        struct stat st;
+        if ( isExcluded( file.relpath ) || stat( file.path.c_str(), &st ) != 0 )
+          continue;
+        if ( S_ISDIR(st.st_mode) ) {
+          /// Symbolic links are followed, but each directory only scanned once to avoid loops ///
+          lock.lock();
+          bool first = visited.insert( std::make_pair( st.st_dev, st.st_ino ) ).second;
+          lock.unlock();
+          if ( first )
+            subdirs.push_back( file.relpath );
+          else
+            logWarning( "skipping already scanned directory: %s", file.path.c_str() );
+        }
+        else if ( S_ISREG(st.st_mode) && isIncluded( file.relpath ) ) {
+          file.size = st.st_size;
+          files.push_back( file );
+        }
+      }
+      if ( dp != NULL )
+        closedir( dp );
+
+      lock.lock();
+      busy--;
+      found.insert( found.end(), files.begin(), files.end() );
+      pending.insert( pending.end(), subdirs.begin(), subdirs.end() );
+      cond.notify_all();
+    }
+  };
+
+  int num_threads = std::max( 1, std::min( 8, (int)std::thread::hardware_concurrency() ) );
+  std::vector<std::thread> threads;
+  for ( int n=0; n<num_threads; n++ )
+    threads.push_back( std::thread(scanner) );
+  for ( auto& thread : threads )
+    thread.join();
+
+  std::sort( found.begin(), found.end(), []( const DiscoveredFile& a, const DiscoveredFile& b ) { return a.relpath < b.relpath; } );
+  return found;
+}
+
+#ifdef __TESSREC_LIBARCHIVE__
+/**
+ * Opens an archive for writing, format selected from the file name extension.
+ */
+struct archive* archiveWriteOpen( const char* fname ) {
+  std::regex reIsZip(".+\\.zip$",std::regex_constants::icase);
+  std::regex reIsTgz(".+\\.(tgz|tar\\.gz)$",std::regex_constants::icase);
+  struct archive* out = archive_write_new();
+  if ( std::regex_match(fname,reIsZip) )
+    archive_write_set_format_zip( out );
+  else {
+    if ( std::regex_match(fname,reIsTgz) )
+      archive_write_add_filter_gzip( out );
+    archive_write_set_format_pax_restricted( out );
+  }
+  if ( archive_write_open_filename( out, fname ) != ARCHIVE_OK ) {
+    logError( "unable to open output archive: %s :: %s", fname, archive_error_string(out) );
+    archive_write_free( out );
+    return NULL;
+  }
+  return out;
+}
+
+/**
+ * Adds a regular file member to an archive being written.
+ */
+bool archiveWriteMember( struct archive* out, const std::string& name, const std::string& content ) {
+  struct archive_entry* entry = archive_entry_new();
+  archive_entry_set_pathname( entry, name.c_str() );
+  archive_entry_set_size( entry, content.size() );
+  archive_entry_set_filetype( entry, AE_IFREG );
+  archive_entry_set_perm( entry, 0644 );
+  archive_entry_set_mtime( entry, time(NULL), 0 );
+  bool ok = archive_write_header( out, entry ) == ARCHIVE_OK &&
+            archive_write_data( out, content.data(), content.size() ) == (la_ssize_t)content.size();
+  if ( ! ok )
+    logError( "problems writing archive member: %s :: %s", name.c_str(), archive_error_string(out) );
+  archive_entry_free( entry );
+  return ok;
+}
+
+/// Size of archive members kept in memory for a single output above which a warning is given ///
+#define ARCHIVE_BUFFER_WARN ((size_t)256<<20)
+
+/**
+ * Reads the image members of an archive, calling a function for each one.
+ * Tar (possibly compressed) is read as a stream, zip through its central
+ * directory. Member names are sanitized so that they are always relative.
+ *
+ * @param fname   Archive file name.
+ * @param func    Function called for each member read.
+ * @param filter  If given, called with the name and size of each member before reading it, skipped if false.
+ * @return        Number of members for which the function failed, -1 if the archive could not be read.
+ */
+int archiveReadMembers( const char* fname, std::function<int(InputFile&)> func, std::function<bool(const std::string&,int64_t)> filter = nullptr ) {
+  std::regex reIsZip(".+\\.zip$",std::regex_constants::icase);
+  std::regex reIsMemberImage(".+\\.(png|jpe?g|tiff?|bmp|gif|webp|jp2|pnm|pbm|pgm|ppm)$",std::regex_constants::icase);
+  struct archive* in = archive_read_new();
+  archive_read_support_filter_all( in );
+  if ( std::regex_match(fname,reIsZip) )
+    archive_read_support_format_zip_seekable( in );
+  else
+    archive_read_support_format_tar( in );
+  if ( archive_read_open_filename( in, fname, 1<<16 ) != ARCHIVE_OK ) {
+    logError( "unable to open archive: %s :: %s", fname, archive_error_string(in) );
+    archive_read_free( in );
+    return -1;
+  }
+
+  int failed = 0;
+  struct archive_entry* entry;
+  int r;
+  while ( ( r = archive_read_next_header( in, &entry ) ) == ARCHIVE_OK ) {
+    if ( archive_entry_filetype(entry) != AE_IFREG )
+      continue;
+    std::string name = std::regex_replace( archive_entry_pathname(entry), std::regex("^(\\.?/)+"), "" );
+    if ( ! std::regex_match(name,reIsMemberImage) )
+      continue;
+    if ( std::regex_search(name,std::regex("(^|/)\\.\\.(/|$)")) ) {
+      logWarning( "skipping archive member with unsafe path: %s", name.c_str() );
+      continue;
+    }
+    if ( filter && ! filter( name, archive_entry_size_is_set(entry) ? archive_entry_size(entry) : 0 ) ) {
+      archive_read_data_skip( in );
+      continue;
+    }
+
+    InputFile member;
+    member.name = name;
+    if ( archive_entry_size_is_set(entry) )
+      member.data.reserve( archive_entry_size(entry) );
+    l_uint8 buf[1<<16];
+    la_ssize_t size;
+    while ( ( size = archive_read_data( in, buf, sizeof(buf) ) ) > 0 )
+      member.data.insert( member.data.end(), buf, buf+size );
+    if ( size < 0 || member.data.empty() ) {
+      logError( "problems reading archive member: %s :: %s", name.c_str(), archive_error_string(in) );
+      failed++;
+      continue;
+    }
+
+    if ( func(member) )
+      failed++;
+  }
+  if ( r != ARCHIVE_EOF ) {
+    logError( "problems reading archive: %s :: %s", fname, archive_error_string(in) );
+    failed = -1;
+  }
+
+  archive_read_free( in );
+  return failed;
+}
+#endif
+
+/// Resolutions outside of this range are not credible, as in tesseract ///
+#define MIN_CREDIBLE_RESOLUTION 70
+#define MAX_CREDIBLE_RESOLUTION 2400
+
+/**
+ * Estimates the resolution of an image from the median height of its connected
+ * components, assuming that most of them are characters of a ~10pt font.
+ *
+ * @param image   Image to analyze.
+ * @return        Estimated resolution in dpi, 0 if no characters found.
+ */
+int estimateResolution( PIX* image ) {
+  PIX* binary = pixConvertTo1( image, 128 );
+  if ( binary == NULL )
+    return 0;
+  BOXA* boxa = pixConnCompBB( binary, 8 );
+  pixDestroy( &binary );
+  if ( boxa == NULL )
+    return 0;
+
+  /// Heights of components that could be characters, excluding specks and large blobs ///
+  std::vector<int> heights;
+  int maxh = pixGetHeight(image) / 10;
+  for ( int n=boxaGetCount(boxa)-1; n>=0; n-- ) {
+    l_int32 w, h;
+    boxaGetBoxGeometry( boxa, n, NULL, NULL, &w, &h );
+    if ( h >= 4 && h <= maxh && w <= 4*h )
+      heights.push_back( h );
+  }
+  boxaDestroy( &boxa );
+  if ( heights.size() < 10 )
+    return 0;
+
+  /// A 10pt character is in average about 1/12 inch high ///
+  std::nth_element( heights.begin(), heights.begin()+heights.size()/2, heights.end() );
+  int resolution = 12*heights[heights.size()/2];
+  return std::max( MIN_CREDIBLE_RESOLUTION, std::min( MAX_CREDIBLE_RESOLUTION, resolution ) );
+}
+
+/**
+ * Attaches a dictionary to the document if it does not have one, so that
+ * libxml2 stores once the names of the elements and attributes created
+ * afterwards with the document.
+ *
+ * @param doc  The document.
+ */
+void attachDocDict( xmlDocPtr doc ) {
+  if ( doc != NULL && doc->dict == NULL )
+    doc->dict = xmlDictCreate();
+}
+
+/**
+ * Checks once that an element created by PageXML has its name in the
+ * dictionary of the document, warning if it does not.
+ *
+ * @param node  Element created after attachDocDict.
+ */
+void checkDocDict( xmlNodePtr node ) {
+  static std::atomic<bool> checked( false );
+  if ( node == NULL || node->doc == NULL || node->doc->dict == NULL || checked.exchange( true ) )
+    return;
+  if ( ! xmlDictOwns( node->doc->dict, node->name ) )
+    logWarning( "page xml elements are not created through the document dictionary, names are not interned" );
+}
+
+/**
+ * Adds a non-text block as an ImageRegion or SeparatorRegion, noise is ignored.
+ *
+ * @param page     The Page XML.
+ * @param xpg      The Page node.
+ * @param type     Tesseract block type.
+ * @param prefix   Prefix for the region id.
+ * @param num      Number of the non-text block, used for the id.
+ */
+void addNonTextRegion( PageXML& page, xmlNodePtr xpg, PolyBlockType type, const std::string& prefix, int num, int left, int top, int right, int bottom ) {
+  const char* name = NULL;
+  if ( type == PT_FLOWING_IMAGE || type == PT_HEADING_IMAGE || type == PT_PULLOUT_IMAGE )
+    name = "ImageRegion";
+  else if ( type == PT_HORZ_LINE || type == PT_VERT_LINE )
+    name = "SeparatorRegion";
+  if ( name == NULL )
+    return;
+  std::string id = prefix + ( name[0] == 'I' ? "i" : "s" ) + std::to_string(num);
+  xmlNodePtr xreg = page.addElem( name, id.c_str(), xpg );
+  std::vector<cv::Point2f> points = {
+    cv::Point2f(left,top),
+    cv::Point2f(right,top),
+    cv::Point2f(right,bottom),
+    cv::Point2f(left,bottom) };
+  page.setCoords( xreg, points );
+}
+
+/**
+ * Blocks of a layout analysis for recognizing only the text ones.
+ */
+struct LayoutBlock {
+  PolyBlockType type;
+  int left, top, right, bottom;
+};
+
+struct TextBlocks {
+  std::vector<LayoutBlock> blocks;
+  size_t next;
+  int nontext;
+  bool add_nontext;
+  std::string prefix;
+  int x, y;
+};
+
+/**
+ * Runs layout analysis keeping the blocks, since the iterator is invalidated by
+ * the recognition.
+ */
+void analyseTextBlocks( tesseract::TessBaseAPI* tessApi, TextBlocks& tb ) {
+  tb.blocks.clear();
+  tb.next = 0;
+  tesseract::PageIterator* layout = tessApi->AnalyseLayout();
+  if ( layout != NULL && ! layout->Empty( tesseract::RIL_BLOCK ) )
+    do {
+      LayoutBlock b;
+      b.type = layout->BlockType();
+      layout->BoundingBox( tesseract::RIL_BLOCK, &b.left, &b.top, &b.right, &b.bottom );
+      tb.blocks.push_back( b );
+    } while ( layout->Next( tesseract::RIL_BLOCK ) );
+  delete layout;
+}
+
+/**
+ * Recognizes the next text block of a layout analysis as a single block.
+ *
+ * @param tessApi   Tesseract instance with the image set.
+ * @param tb        Layout blocks, non-text ones skipped are added to the page if requested.
+ * @param iter      Replaced by the iterator of the recognized block.
+ * @return          Whether there was a text block left.
+ */
+bool nextTextBlock( tesseract::TessBaseAPI* tessApi, TextBlocks& tb, PageXML& page, xmlNodePtr xpg, tesseract::ResultIterator*& iter ) {
+  while ( tb.next < tb.blocks.size() ) {
+    const LayoutBlock& b = tb.blocks[tb.next++];
+    if ( b.type > PT_CAPTION_TEXT ) {
+      if ( tb.add_nontext )
+        addNonTextRegion( page, xpg, b.type, tb.prefix, ++tb.nontext, tb.x+b.left, tb.y+b.top, tb.x+b.right, tb.y+b.bottom );
+      continue;
+    }
+    delete iter;
+    tessApi->SetRectangle( b.left, b.top, b.right-b.left, b.bottom-b.top );
+    tessApi->SetPageSegMode( tesseract::PSM_SINGLE_BLOCK );
+    tessApi->Recognize( 0 );
+    tessApi->SetPageSegMode( (tesseract::PageSegMode)gb_psm );
+    iter = tessApi->GetIterator();
+    if ( iter != NULL && ! iter->Empty( tesseract::RIL_BLOCK ) )
+      return true;
+  }
+  return false;
+}
 
+/**
+ * Post-processes a page once all of its images have been recognized: applies
+ * the image orientation, fixes it using the baselines and fills in the Coords
+ * of words without bounding box.
+ *
+ * @param page  PageXML object.
+ * @param xpg   Page element.
+ */
+void postprocessPage( PageXML& page, xmlNodePtr xpg ) {
   /// Apply image orientations ///
-  std::vector<xmlNodePtr> sel = page.select("//_:Page[_:Property/@key='apply-image-orientation']");
-  for ( n=(int)sel.size()-1; n>=0; n-- ) {
-    int angle = atoi( page.getPropertyValue( sel[n], "apply-image-orientation" ).c_str() );
+  if ( page.count("_:Property[@key='apply-image-orientation']", xpg) > 0 ) {
+    int angle = atoi( page.getPropertyValue( xpg, "apply-image-orientation" ).c_str() );
     if ( angle )
-      page.rotatePage( -angle, sel[n], true );
-    page.rmElems( page.select("_:Property[@key='apply-image-orientation']", sel[n]) );
-    std::vector<xmlNodePtr> lines = page.select(".//_:TextLine",sel[n]);
+      page.rotatePage( -angle, xpg, true );
+    page.rmElems( page.select("_:Property[@key='apply-image-orientation']", xpg) );
+    std::vector<xmlNodePtr> lines = page.select(".//_:TextLine",xpg);
     /// Fix image orientation using baselines ///
     if ( lines.size() > 0 ) {
       double domangle = page.getDominantBaselinesOrientation(lines);
@@ -810,23 +1936,23 @@ int main( int argc, char *argv[] ) {
       else if ( domangle >= 3*M_PI/4 || domangle <= -3*M_PI/4 )
         angle = 180;
       if ( angle )
-        page.rotatePage(angle, sel[n], true);
+        page.rotatePage(angle, xpg, true);
     }
   }
 
   /// Fill in "0,0 0,0" Word Coords ///
-  sel = page.select("//_:Word[_:Coords/@points='0,0 0,0']");
-  for ( n=(int)sel.size()-1; n>=0; n-- ) {
+  std::vector<xmlNodePtr> sel = page.select(".//_:Word[_:Coords/@points='0,0 0,0']", xpg);
+  for ( int n=(int)sel.size()-1; n>=0; n-- ) {
     xmlNodePtr elem = sel[n];
     xmlNodePtr elem_pre = page.selectNth("preceding-sibling::_:Word[_:Coords/@points!='0,0 0,0']", -1, elem);
     xmlNodePtr elem_fol = page.selectNth("following-sibling::_:Word[_:Coords/@points!='0,0 0,0']", 0, elem);
     if ( elem_pre == NULL && elem_fol == NULL ) {
-      page.setCoords(elem, page.getPoints(page.parent(elem)));
+      page.setCoords(elem, getCoordsPoints(page, page.parent(elem)));
       page.setProperty(elem, "coords-unk-filler");
       continue;
     }
-    std::vector<cv::Point2f> pts_pre = page.getPoints(elem_pre);
-    std::vector<cv::Point2f> pts_fol = page.getPoints(elem_fol);
+    std::vector<cv::Point2f> pts_pre = elem_pre == NULL ? std::vector<cv::Point2f>() : getCoordsPoints(page, elem_pre);
+    std::vector<cv::Point2f> pts_fol = elem_fol == NULL ? std::vector<cv::Point2f>() : getCoordsPoints(page, elem_fol);
     std::vector<cv::Point2f> pts;
     if ( elem_pre != NULL && elem_fol != NULL ) {
       pts.push_back(pts_pre[1]);
@@ -857,23 +1983,2136 @@ int main( int argc, char *argv[] ) {
     page.setCoords(elem, pts);
     page.setProperty(elem, "coords-unk-filler");
   }
+}
 
-  /// Try to make imageFilename be a relative path w.r.t. the output XML ///
-  if ( ! input_xml && ! gb_inplace && strcmp(gb_output,"-") )
-    page.relativizeImageFilename(gb_output);
+/// State of the recognition into a page xml, of the document or of a page in a worker ///
+struct PageWork {
+  tesseract::TessBaseAPI* tessApi = NULL;
+  PageXML* page = NULL;
+  xmlNodePtr last_page = NULL;
+  DirectOutputs douts;
+  xmlNodePtr douts_page = NULL;
+  DocumentSummary summary;
+  xmlNodePtr summary_page = NULL;
+  GlyphSidecar sidecar;
+  LineGeometry line_geometry;
+  std::set<xmlNodePtr> postprocessed;
+  double page_ms = 0.0;
+};
 
-  /// Write resulting XML ///
-  int bytes = page.write( gb_inplace ? input_file : gb_output );
-  if ( bytes <= 0 )
-    fprintf( stderr, "%s: error: problems writing to output xml\n", tool );
+/**
+ * Recognizes an image adding the results to the page xml and other outputs of a work.
+ *
+ * @param work         State of the recognition, of the document or of a page.
+ * @param image        Image to recognize and its node in the page xml of the work.
+ * @param image_index  Index of the page image in the page xml, used if the image is not given.
+ * @param pagenum      Number of the page in the document, starting from 1.
+ * @param page_end     Whether it is the last image of its page.
+ * @param mem_input    If not NULL, in-memory input from which to decode the image.
+ * @param input_xml    Whether the input is a page xml.
+ * @param num_pages    Number of pages of the document.
+ * @param log_doc      Document included in the logs.
+ * @return             0 on success, 1 on failure.
+ */
+int processImage( PageWork& work, NamedImage& image, int image_index, int pagenum, bool page_end, const InputFile* mem_input, bool input_xml, int num_pages, const std::string& log_doc ) {
+  PageXML& page = *work.page;
+  tesseract::TessBaseAPI* tessApi = work.tessApi;
+  DirectOutputs& douts = work.douts;
+  DocumentSummary& summary = work.summary;
+  GlyphSidecar& sidecar = work.sidecar;
+  LineGeometry& line_geometry = work.line_geometry;
+  bool direct_outs = gb_text != NULL || gb_tsv != NULL || gb_alto != NULL || gb_hocr != NULL;
+  static std::mutex load_mutex; // pdf rendering is not reentrant
+  static const std::regex reIsPdf(".+\\.pdf(|\\[[-, 0-9]+\\])$",std::regex_constants::icase);
+  tesseract::ResultIterator* iter = NULL;
 
-  /// Release resources ///
-  if ( pixRelease )
-    for ( n=0; n<(int)images.size(); n++ )
-      pixDestroy(&(images[n].image));
-  tessApi->End();
-  delete tessApi;
-  delete iter;
+  xmlNodePtr xpg = page.closest( "Page", image.node );
+  logContext( log_doc, pagenum );
 
-  return bytes <= 0 ? 1 : 0;
+  /// Release the iterator and the decoded in-memory image also on error returns ///
+  ScopeExit release( [&]() {
+    delete iter;
+    if ( mem_input != NULL )
+      pixDestroy(&(image.image));
+  } );
+
+  /// Several images can be of the same page for xml input, only reset when page changes ///
+  if ( gb_adaptive_reset == RESET_PAGE && work.last_page != NULL && xpg != work.last_page )
+    tessApi->ClearAdaptiveClassifier();
+  work.last_page = xpg;
+
+  /// Start page in direct outputs, several images can be of the same page for xml input ///
+  if ( direct_outs && xpg != work.douts_page ) {
+    if ( work.douts_page != NULL )
+      directPageEnd( douts );
+    directPageBegin( douts, pagenum, page.getAttr( xpg, "imageFilename" ), page.getPageWidth(xpg), page.getPageHeight(xpg) );
+    work.douts_page = xpg;
+  }
+  if ( gb_summary != NULL && xpg != work.summary_page ) {
+    summaryPage( summary, pagenum );
+    work.summary_page = xpg;
+  }
+  std::chrono::steady_clock::time_point image_start = std::chrono::steady_clock::now();
+
+  /// The outcome is logged once per page, error returns with the time until failing ///
+  bool image_ok = false;
+  ScopeExit log_failed( [&]() {
+    if ( image_ok )
+      return;
+    logPage( "failed", work.page_ms + std::chrono::duration<double,std::milli>( std::chrono::steady_clock::now() - image_start ).count() );
+    work.page_ms = 0.0;
+  } );
+
+  if ( mem_input != NULL ) {
+    image.image = pixReadMem( mem_input->data.data(), mem_input->data.size() );
+    if ( image.image == NULL ) {
+      logError( "problems reading image: %s", mem_input->name.c_str() );
+      return 1;
+    }
+  }
+  else if ( image.image == NULL ) {
+    try {
+      std::unique_lock<std::mutex> lock( load_mutex, std::defer_lock );
+      if ( std::regex_match( page.getAttr( xpg, "imageFilename" ), reIsPdf ) )
+        lock.lock();
+      page.loadImage(xpg, NULL, true, gb_density );
+      image.image = page.getPageImage(image_index);
+    } catch ( const std::exception& e ) {
+      logError( "problems loading page image: %s :: %s", page.getPageImageFilename(image_index).c_str(), e.what() );
+      return 1;
+    }
+  }
+
+  tessApi->SetImage( image.image );
+
+  /// Source resolution from image header, pdf density, page property or estimated, in that order ///
+  int resolution = pixGetYRes( image.image );
+  const char* resolution_from = "header";
+  if ( resolution < MIN_CREDIBLE_RESOLUTION && std::regex_match( page.getAttr( xpg, "imageFilename" ), reIsPdf ) ) {
+    resolution = gb_density;
+    resolution_from = "density";
+  }
+  if ( resolution < MIN_CREDIBLE_RESOLUTION ) {
+    resolution = atoi( page.getPropertyValue( xpg, "source-resolution" ).c_str() );
+    resolution_from = NULL;
+  }
+  if ( resolution < MIN_CREDIBLE_RESOLUTION ) {
+    resolution = estimateResolution( image.image );
+    resolution_from = "estimated";
+  }
+  if ( resolution >= MIN_CREDIBLE_RESOLUTION ) {
+    tessApi->SetSourceResolution( resolution );
+    if ( resolution_from != NULL && gb_xml ) {
+      page.setProperty( xpg, "source-resolution", resolution );
+      page.setProperty( xpg, "source-resolution-from", resolution_from );
+    }
+  }
+
+  /// Extra languages recognize lines of the same thresholded image, set before any rectangle ///
+  if ( ! gb_extra_apis.empty() ) {
+    PIX* binary = tessApi->GetThresholdedImage();
+    for ( auto& extra : gb_extra_apis ) {
+      extra.second->SetImage( binary );
+      if ( resolution >= MIN_CREDIBLE_RESOLUTION )
+        extra.second->SetSourceResolution( resolution );
+    }
+    pixDestroy( &binary );
+  }
+
+  if ( gb_save_crops && input_xml ) {
+    std::string fout = std::string("crop_")+std::to_string(image_index)+"_"+image.id+".png";
+    logInfo( "writing cropped image: %s", fout.c_str() );
+    pixWriteImpliedFormat( fout.c_str(), image.image, 0, 0 );
+  }
+
+  /// For xml input setup node level ///
+  xmlNodePtr node = NULL;
+  int node_level = -1;
+  if ( input_xml ) {
+    node = image.node->parent;
+    if ( page.nodeIs( node, "TextRegion" ) )
+      node_level = LEVEL_REGION;
+    else if ( page.nodeIs( node, "TextLine" ) ) {
+      node_level = LEVEL_LINE;
+      if ( gb_psm != tesseract::PSM_SINGLE_LINE && gb_psm != tesseract::PSM_RAW_LINE ) {
+        logError( "for xml input selecting text lines, valid page segmentation modes are %d and %d", tesseract::PSM_SINGLE_LINE, tesseract::PSM_RAW_LINE );
+        return 1;
+      }
+    }
+    else if ( page.nodeIs( node, "Word" ) ) {
+      node_level = LEVEL_WORD;
+      if ( gb_psm != tesseract::PSM_SINGLE_WORD && gb_psm != tesseract::PSM_CIRCLE_WORD ) {
+        logError( "for xml input selecting words, valid page segmentation modes are %d and %d", tesseract::PSM_SINGLE_WORD, tesseract::PSM_CIRCLE_WORD );
+        return 1;
+      }
+    }
+    else if ( page.nodeIs( node, "Glyph" ) ) {
+      node_level = LEVEL_GLYPH;
+      if ( gb_psm != tesseract::PSM_SINGLE_CHAR ) {
+        logError( "for xml input selecting glyphs, the only valid page segmentation mode is %d", tesseract::PSM_SINGLE_CHAR );
+        return 1;
+      }
+    }
+    if ( gb_layoutlevel < node_level ) {
+      logError( "layout level lower than xpath selection level" );
+      return 1;
+    }
+    if ( ! gb_xml )
+      node = NULL;
+  }
+
+  /// Non-text blocks as regions only if regions are being added ///
+  TextBlocks tb;
+  tb.nontext = 0;
+  tb.add_nontext = gb_nontext_regions && gb_xml && node_level < LEVEL_REGION;
+  tb.prefix = num_pages > 1 ? std::string("pg") + std::to_string(pagenum) + "_" : std::string();
+  tb.x = image.x;
+  tb.y = image.y;
+
+  /// Perform layout analysis ///
+  if ( gb_onlylayout && gb_psm != tesseract::PSM_AUTO_OSD )
+    iter = (tesseract::ResultIterator*)( tessApi->AnalyseLayout() );
+
+  /// Perform layout analysis and then recognition of only the text blocks ///
+  else if ( gb_text_blocks ) {
+    analyseTextBlocks( tessApi, tb );
+    nextTextBlock( tessApi, tb, page, xpg, iter );
+  }
+
+  /// Perform recognition ///
+  else {
+    tessApi->Recognize( 0 );
+    iter = tessApi->GetIterator();
+  }
+
+  if ( iter != NULL && ! iter->Empty( tesseract::RIL_BLOCK ) ) {
+    /// Orientation and Script Detection ///
+    tesseract::Orientation orientation;
+    tesseract::WritingDirection writing_direction;
+    tesseract::TextlineOrder textline_order;
+    float deskew_angle;
+    iter->Orientation( &orientation, &writing_direction, &textline_order, &deskew_angle );
+
+    if ( gb_psm == tesseract::PSM_AUTO_OSD ) {
+      if ( deskew_angle != 0.0 )
+        page.setProperty( xpg, "deskewAngle", deskew_angle );
+      switch ( orientation ) {
+        case tesseract::ORIENTATION_PAGE_RIGHT:          page.setProperty( xpg, "apply-image-orientation", -90 );      break;
+        case tesseract::ORIENTATION_PAGE_LEFT:           page.setProperty( xpg, "apply-image-orientation", 90 );       break;
+        case tesseract::ORIENTATION_PAGE_DOWN:           page.setProperty( xpg, "apply-image-orientation", 180 );      break;
+        default: break;
+      }
+      switch ( writing_direction ) {
+        case tesseract::WRITING_DIRECTION_LEFT_TO_RIGHT: page.setProperty( xpg, "readingDirection", "left-to-right" ); break;
+        case tesseract::WRITING_DIRECTION_RIGHT_TO_LEFT: page.setProperty( xpg, "readingDirection", "right-to-left" ); break;
+        case tesseract::WRITING_DIRECTION_TOP_TO_BOTTOM: page.setProperty( xpg, "readingDirection", "top-to-bottom" ); break;
+      }
+      switch ( textline_order ) {
+        case tesseract::TEXTLINE_ORDER_LEFT_TO_RIGHT:    page.setProperty( xpg, "textLineOrder", "left-to-right" );    break;
+        case tesseract::TEXTLINE_ORDER_RIGHT_TO_LEFT:    page.setProperty( xpg, "textLineOrder", "right-to-left" );    break;
+        case tesseract::TEXTLINE_ORDER_TOP_TO_BOTTOM:    page.setProperty( xpg, "textLineOrder", "top-to-bottom" );    break;
+      }
+    }
+
+    /// Loop through blocks ///
+    int block = 0;
+    int min_conf_count = 0;
+    bool prune = gb_min_conf > 0.0 && ! gb_min_conf_flag && ! gb_onlylayout && gb_layoutlevel >= gb_min_conf_level && node_level < gb_min_conf_level;
+    std::vector<PrunedLine> pruned;
+    std::string pruned_text;
+    double pruned_conf = 0.0;
+    while ( gb_layoutlevel >= LEVEL_REGION ) {
+      /// Skip non-text blocks ///
+      /*
+       0 PT_UNKNOWN,        // Type is not yet known. Keep as the first element.
+       1 PT_FLOWING_TEXT,   // Text that lives inside a column.
+       2 PT_HEADING_TEXT,   // Text that spans more than one column.
+       3 PT_PULLOUT_TEXT,   // Text that is in a cross-column pull-out region.
+       4 PT_EQUATION,       // Partition belonging to an equation region.
+       5 PT_INLINE_EQUATION,  // Partition has inline equation.
+       6 PT_TABLE,          // Partition belonging to a table region.
+       7 PT_VERTICAL_TEXT,  // Text-line runs vertically.
+       8 PT_CAPTION_TEXT,   // Text that belongs to an image.
+       9 PT_FLOWING_IMAGE,  // Image that lives inside a column.
+       10 PT_HEADING_IMAGE,  // Image that spans more than one column.
+       11 PT_PULLOUT_IMAGE,  // Image that is in a cross-column pull-out region.
+       12 PT_HORZ_LINE,      // Horizontal Line.
+       13 PT_VERT_LINE,      // Vertical Line.
+       14 PT_NOISE,          // Lies outside of any column.
+      */
+      if ( iter->BlockType() > PT_CAPTION_TEXT ) {
+        if ( tb.add_nontext ) {
+          int left, top, right, bottom;
+          iter->BoundingBox( tesseract::RIL_BLOCK, &left, &top, &right, &bottom );
+          addNonTextRegion( page, xpg, iter->BlockType(), tb.prefix, ++tb.nontext, tb.x+left, tb.y+top, tb.x+right, tb.y+bottom );
+        }
+        if ( ! iter->Next( tesseract::RIL_BLOCK ) && ! nextTextBlock( tessApi, tb, page, xpg, iter ) )
+          break;
+        continue;
+      }
+
+      block++;
+
+      xmlNodePtr xreg = NULL;
+      std::string rid = "b" + std::to_string(block);
+
+      /// If xml input and region selected, prepend id to rid and set xreg to node ///
+      if ( node_level == LEVEL_REGION ) {
+        rid = std::string(image.id) + "_" + rid;
+        xreg = node;
+      }
+
+      /// If it is multipage, prepend page number to rid ///
+      if ( num_pages > 1 )
+        rid = std::string("pg") + std::to_string(pagenum) + "_" + rid;
+
+      /// Dropped elements known beforehand, a block without kept lines is skipped ///
+      if ( prune ) {
+        min_conf_count += pruneBlock( iter, pruned, pruned_text, pruned_conf );
+        if ( node_level < LEVEL_REGION && std::none_of( pruned.begin(), pruned.end(), []( const PrunedLine& l ) { return l.keep; } ) ) {
+          if ( ! iter->Next( tesseract::RIL_BLOCK ) && ! nextTextBlock( tessApi, tb, page, xpg, iter ) )
+            break;
+          continue;
+        }
+      }
+      int pruned_line = 0;
+
+      /// Get block bounding box and text ///
+      WalkElement ereg;
+      setWalkElement( ereg, iter, tesseract::RIL_BLOCK, LEVEL_REGION, rid, image.x, image.y );
+      if ( prune && ereg.has_text ) {
+        ereg.text = pruned_text;
+        ereg.conf = pruned_conf;
+      }
+      if ( gb_summary != NULL )
+        summaryElement( summary, iter, tesseract::RIL_BLOCK, LEVEL_REGION );
+      if ( direct_outs )
+        directElement( douts, pagenum, ereg );
+
+      /// Otherwise add block as TextRegion element ///
+      if ( node_level < LEVEL_REGION && gb_xml ) {
+        xreg = page.addTextRegion( xpg, rid.c_str() );
+
+        /// Set block bounding box and text ///
+        setCoords( iter, tesseract::RIL_BLOCK, page, xreg, image.x, image.y );
+        if ( ! gb_onlylayout && gb_textlevels[LEVEL_REGION] )
+          page.setTextEquiv( xreg, ereg.text.c_str(), &ereg.conf );
+      }
+
+      /// Set rotation and reading direction ///
+      /*tesseract::Orientation orientation;
+      tesseract::WritingDirection writing_direction;
+      tesseract::TextlineOrder textline_order;
+      float deskew_angle;*/
+      iter->Orientation( &orientation, &writing_direction, &textline_order, &deskew_angle );
+      if ( xreg != NULL && ( ! input_xml || node_level <= LEVEL_REGION ) ) {
+        if ( deskew_angle != 0.0 )
+          page.setProperty( xpg, "deskewAngle", deskew_angle );
+        PAGEXML_READ_DIRECTION direct = PAGEXML_READ_DIRECTION_LTR;
+        switch( writing_direction ) {
+          case tesseract::WRITING_DIRECTION_LEFT_TO_RIGHT: direct = PAGEXML_READ_DIRECTION_LTR; break;
+          case tesseract::WRITING_DIRECTION_RIGHT_TO_LEFT: direct = PAGEXML_READ_DIRECTION_RTL; break;
+          case tesseract::WRITING_DIRECTION_TOP_TO_BOTTOM: direct = PAGEXML_READ_DIRECTION_TTB; break;
+        }
+        page.setReadingDirection( xreg, direct );
+        /*float orient = 0.0;
+        switch( orientation ) {
+          case tesseract::ORIENTATION_PAGE_UP:    orient = 0.0;   break;
+          case tesseract::ORIENTATION_PAGE_RIGHT: orient = -90.0; break;
+          case tesseract::ORIENTATION_PAGE_LEFT:  orient = 90.0;  break;
+          case tesseract::ORIENTATION_PAGE_DOWN:  orient = 180.0; break;
+        }
+        page.setRotation( xreg, orient );*/
+      }
+
+      /// Loop through paragraphs in current block ///
+      int para = 0;
+      while ( gb_layoutlevel >= LEVEL_REGION ) {
+        para++;
+
+        /// Loop through lines in current paragraph ///
+        int line = 0;
+        while ( gb_layoutlevel >= LEVEL_LINE ) {
+          line++;
+
+          xmlNodePtr xline = NULL;
+          std::string lid = rid + "_p" + std::to_string(para) + "_l" + std::to_string(line);
+
+          /// Low confidence lines, or lines without kept words, are dropped before creating any node, or flagged ///
+          bool line_low = node_level < LEVEL_LINE && belowMinConf( iter, tesseract::RIL_TEXTLINE, LEVEL_LINE );
+          bool line_drop = node_level < LEVEL_LINE && prune && ! pruned[pruned_line].keep;
+          if ( line_low && gb_min_conf_flag )
+            min_conf_count++;
+
+          /// If xml input and line selected, set xline to node ///
+          if ( node_level == LEVEL_LINE ) {
+            xline = node;
+            lid = page.getAttr( image.node->parent, "id" );
+          }
+
+          /// Otherwise add TextLine element ///
+          else if ( node_level < LEVEL_LINE && gb_xml && ! line_drop ) {
+            xline = page.addTextLine( xreg, lid.c_str() );
+            checkDocDict( xline );
+          }
+
+          /// Get line bounding box and text ///
+          WalkElement eline;
+          if ( node_level <= LEVEL_LINE && ! line_drop ) {
+            setWalkElement( eline, iter, tesseract::RIL_TEXTLINE, LEVEL_LINE, lid, image.x, image.y );
+            if ( prune && eline.has_text ) {
+              eline.text = pruned[pruned_line].text;
+              eline.conf = pruned[pruned_line].conf;
+            }
+            if ( gb_summary != NULL )
+              summaryElement( summary, iter, tesseract::RIL_TEXTLINE, LEVEL_LINE );
+            if ( direct_outs )
+              directElement( douts, pagenum, eline );
+          }
+
+          /// Set line bounding box, baseline and text ///
+          if ( xline != NULL ) {
+            setLineCoords( iter, tesseract::RIL_TEXTLINE, page, xline, image.x, image.y, orientation, line_geometry );
+            if ( ! gb_onlylayout && gb_textlevels[LEVEL_LINE] && gb_extra_apis.empty() )
+              page.setTextEquiv( xline, eline.text.c_str(), &eline.conf );
+
+            /// With extra languages a TextEquiv for each, with index and the language as comments ///
+            else if ( ! gb_onlylayout && gb_textlevels[LEVEL_LINE] ) {
+              page.setAttr( page.setTextEquiv( xline, eline.text.c_str(), &eline.conf, 0 ), "comments", gb_lang );
+              for ( int l=0; l<(int)gb_extra_apis.size(); l++ ) {
+                std::string text;
+                double conf;
+                recognizeLine( gb_extra_apis[l].second, eline.left-image.x, eline.top-image.y, eline.right-image.x, eline.bottom-image.y, text, conf );
+                page.setAttr( page.setTextEquiv( xline, text.c_str(), &conf, l+1 ), "comments", gb_extra_apis[l].first.c_str() );
+              }
+            }
+            if ( line_low )
+              page.setProperty( xline, "low-confidence" );
+          }
+
+          /// Loop through words in current text line ///
+          int word = 0;
+          WalkElement eword_prev;
+          bool has_prev = false;
+          UnboxedWords unboxed;
+          while ( gb_layoutlevel >= LEVEL_WORD && ! line_drop ) {
+            word++;
+
+            xmlNodePtr xword = NULL;
+
+            /// Low confidence words are dropped before creating any node, or flagged ///
+            bool word_low = node_level < LEVEL_WORD && belowMinConf( iter, tesseract::RIL_WORD, LEVEL_WORD );
+            bool word_drop = word_low && ! gb_min_conf_flag;
+            if ( word_low && gb_min_conf_flag )
+              min_conf_count++;
+
+            /// If xml input and word selected, set xword to node ///
+            if ( node_level == LEVEL_WORD )
+              xword = node;
+
+            /// Otherwise add Word element ///
+            else if ( node_level < LEVEL_WORD && gb_xml && ! word_drop )
+              xword = page.addWord( xline );
+
+            /// Get word bounding box and text, ids as in the Page XML ///
+            WalkElement eword;
+            std::string wid;
+            if ( node_level <= LEVEL_WORD && ! word_drop ) {
+              if ( direct_outs || gb_glyphs != NULL )
+                wid = xword != NULL ? page.getAttr( xword, "id" ) : lid + "_w" + std::to_string(word);
+              setWalkElement( eword, iter, tesseract::RIL_WORD, LEVEL_WORD, wid, image.x, image.y );
+              if ( direct_outs && node_level <= LEVEL_LINE ) {
+                if ( eword.left == image.x && eword.top == image.y &&
+                     eword.right-image.x == (int)page.getPageWidth(xpg) && eword.bottom-image.y == (int)page.getPageHeight(xpg) )
+                  unboxed.push_back( std::make_pair( eword, DirectOutputs() ) );
+                else {
+                  directUnboxedWords( douts, pagenum, unboxed, has_prev ? &eword_prev : NULL, &eword, eline );
+                  eword_prev = eword;
+                  has_prev = true;
+                }
+              }
+              if ( gb_summary != NULL )
+                summaryElement( summary, iter, tesseract::RIL_WORD, LEVEL_WORD );
+              if ( direct_outs && unboxed.empty() )
+                directElement( douts, pagenum, eword );
+              if ( gb_glyphs != NULL )
+                sidecarWord( sidecar, pagenum, wid );
+            }
+
+            /// Set word bounding box and text ///
+            if ( xword != NULL ) {
+              setCoords( iter, tesseract::RIL_WORD, page, xword, image.x, image.y, orientation );
+              if ( ! gb_onlylayout && gb_textlevels[LEVEL_WORD] )
+                page.setTextEquiv( xword, eword.text.c_str(), &eword.conf );
+              if ( word_low )
+                page.setProperty( xword, "low-confidence" );
+            }
+
+            /// Loop through symbols in current word ///
+            /// The symbols are also walked for the sidecar while keeping the xml at word level ///
+            /// The glyphs of a held back word are written after it ///
+            DirectOutputs& wouts = unboxed.empty() || word_drop ? douts : unboxed.back().second;
+            bool sidecar_word = gb_glyphs != NULL && node_level <= LEVEL_WORD && ! word_drop;
+            int glyph = 0;
+            while ( ( gb_layoutlevel >= LEVEL_GLYPH || sidecar_word ) && ! word_drop ) {
+              glyph++;
+
+              /// Set xglyph to node or add new Glyph element depending on the case ///
+              xmlNodePtr xglyph = node_level == LEVEL_GLYPH ? node : ( gb_xml && gb_layoutlevel >= LEVEL_GLYPH ? page.addGlyph( xword ) : NULL );
+
+              /// Get symbol bounding box and text ///
+              WalkElement eglyph;
+              std::string gid;
+              if ( direct_outs && gb_layoutlevel >= LEVEL_GLYPH )
+                gid = xglyph != NULL ? page.getAttr( xglyph, "id" ) : wid + "_g" + std::to_string(glyph);
+              setWalkElement( eglyph, iter, tesseract::RIL_SYMBOL, LEVEL_GLYPH, gid, image.x, image.y );
+              if ( gb_summary != NULL )
+                summaryElement( summary, iter, tesseract::RIL_SYMBOL, LEVEL_GLYPH );
+              if ( direct_outs && gb_layoutlevel >= LEVEL_GLYPH )
+                directElement( wouts, pagenum, eglyph );
+              if ( sidecar_word )
+                sidecarGlyph( sidecar, eglyph );
+
+              /// Set symbol bounding box and text ///
+              if ( xglyph != NULL ) {
+                setCoords( iter, tesseract::RIL_SYMBOL, page, xglyph, image.x, image.y, orientation );
+                if ( ! gb_onlylayout && gb_textlevels[LEVEL_GLYPH] && eglyph.alts.empty() )
+                  page.setTextEquiv( xglyph, eglyph.text.c_str(), &eglyph.conf );
+
+                /// With alternatives, recognized text as index 0 followed by the other choices ///
+                else if ( ! gb_onlylayout && gb_textlevels[LEVEL_GLYPH] ) {
+                  page.setTextEquiv( xglyph, eglyph.text.c_str(), &eglyph.conf, 0 );
+                  int index = 0;
+                  for ( auto& alt : eglyph.alts )
+                    if ( alt.first != eglyph.text )
+                      page.setTextEquiv( xglyph, alt.first.c_str(), &alt.second, ++index );
+                }
+              }
+
+              if ( iter->IsAtFinalElement( tesseract::RIL_WORD, tesseract::RIL_SYMBOL ) )
+                break;
+              iter->Next( tesseract::RIL_SYMBOL );
+            } // while ( ( gb_layoutlevel >= LEVEL_GLYPH || sidecar_word ) && ! word_drop ) {
+            if ( direct_outs && node_level <= LEVEL_WORD && ! word_drop )
+              directElementEnd( wouts, eword );
+
+            if ( iter->IsAtFinalElement( tesseract::RIL_TEXTLINE, tesseract::RIL_WORD ) )
+              break;
+            iter->Next( tesseract::RIL_WORD );
+          } // while ( gb_layoutlevel >= LEVEL_WORD && ! line_drop ) {
+          directUnboxedWords( douts, pagenum, unboxed, has_prev ? &eword_prev : NULL, NULL, eline );
+          if ( direct_outs && node_level <= LEVEL_LINE && ! line_drop )
+            directElementEnd( douts, eline );
+          pruned_line++;
+
+          if ( iter->IsAtFinalElement( tesseract::RIL_PARA, tesseract::RIL_TEXTLINE ) )
+            break;
+          iter->Next( tesseract::RIL_TEXTLINE );
+        } // while ( gb_layoutlevel >= LEVEL_LINE ) {
+
+        if ( iter->IsAtFinalElement( tesseract::RIL_BLOCK, tesseract::RIL_PARA ) )
+          break;
+        iter->Next( tesseract::RIL_PARA );
+      } // while ( gb_layoutlevel >= LEVEL_REGION ) {
+      if ( direct_outs )
+        directElementEnd( douts, ereg );
+
+      if ( ! iter->Next( tesseract::RIL_BLOCK ) && ! nextTextBlock( tessApi, tb, page, xpg, iter ) )
+        break;
+    } // while ( gb_layoutlevel >= LEVEL_REGION ) {
+
+    /// Summary of low confidence elements, accumulated for several images of the same page ///
+    if ( min_conf_count > 0 ) {
+      const char* key = gb_min_conf_flag ? "min-conf-flagged" : "min-conf-dropped";
+      if ( gb_xml )
+        page.setProperty( xpg, key, min_conf_count + atoi( page.getPropertyValue( xpg, key ).c_str() ) );
+      else
+        logInfo( "page %d: %s %d %ss", pagenum, gb_min_conf_flag ? "flagged" : "dropped", min_conf_count, levelStrings[gb_min_conf_level] );
+    }
+  } // if ( iter != NULL && ! iter->Empty( tesseract::RIL_BLOCK ) ) {
+  setLineGeometries( page, line_geometry );
+  page.releaseImage(xpg);
+
+  /// Post-process the page as soon as its last image is done ///
+  if ( page_end ) {
+    postprocessPage( page, xpg );
+    work.postprocessed.insert( xpg );
+  }
+
+  double image_ms = std::chrono::duration<double,std::milli>( std::chrono::steady_clock::now() - image_start ).count();
+  if ( gb_summary != NULL )
+    summary.pages.back().time_ms += image_ms;
+  work.page_ms += image_ms;
+  if ( page_end ) {
+    logPage( "ok", work.page_ms );
+    work.page_ms = 0.0;
+  }
+  image_ok = true;
+
+  return 0;
+}
+
+/**
+ * Replaces an element by a copy of an element of another document. The
+ * namespaces are resolved in the destination, so no declarations are added.
+ *
+ * @param dest  Element to replace, it is freed.
+ * @param src   Element to copy.
+ * @return      The copy, NULL on failure.
+ */
+xmlNodePtr replaceByCopy( xmlNodePtr dest, xmlNodePtr src ) {
+  xmlNodePtr copy = NULL;
+  if ( xmlDOMWrapCloneNode( NULL, src->doc, src, &copy, dest->doc, dest->parent, 1, 0 ) != 0 || copy == NULL )
+    return NULL;
+  xmlReplaceNode( dest, copy );
+  xmlFreeNode( dest );
+  return copy;
+}
+
+/**
+ * Merges the recognition of a page done by a worker into the one of the document.
+ *
+ * @param work       State of the recognition of the document.
+ * @param page_work  State of the recognition of the page in its private page xml.
+ * @param image      Image of the page in the document, its node is updated.
+ * @param page_node  Page element in the private page xml.
+ * @return           Whether the merge succeeded.
+ */
+bool mergePageWork( PageWork& work, PageWork& page_work, NamedImage& image, xmlNodePtr page_node ) {
+  xmlNodePtr xpg = work.page->closest( "Page", image.node );
+  xmlNodePtr merged = replaceByCopy( xpg, page_node );
+  if ( merged == NULL )
+    return false;
+  image.node = merged;
+  work.postprocessed.insert( merged );
+
+  work.douts.text += page_work.douts.text;
+  work.douts.tsv += page_work.douts.tsv;
+  work.douts.alto += page_work.douts.alto;
+  work.douts.hocr += page_work.douts.hocr;
+  work.summary.pages.insert( work.summary.pages.end(), page_work.summary.pages.begin(), page_work.summary.pages.end() );
+  work.summary.confs.insert( work.summary.confs.end(), page_work.summary.confs.begin(), page_work.summary.confs.end() );
+  sidecarAppend( work.sidecar, page_work.sidecar );
+  return true;
+}
+
+/**
+ * Recognizes the pages of a document in parallel. Each worker, with its own
+ * tesseract instance, builds the pages it takes in private page xmls that
+ * start as a copy of the Page element, so that ids and everything else are
+ * as in the serial case. The main thread merges the pages into the document
+ * in order as they finish.
+ *
+ * @param work        State of the recognition of the document.
+ * @param images      Images of the document, one per page.
+ * @param mem_images  In-memory inputs by image index.
+ * @param num_pages   Number of pages of the document.
+ * @param log_doc     Document included in the logs.
+ * @return            0 on success, 1 on failure.
+ */
+int processImagesParallel( PageWork& work, std::vector<NamedImage>& images, const std::map<int,const InputFile*>& mem_images, int num_pages, const std::string& log_doc ) {
+  PageXML& page = *work.page;
+  int num_images = (int)images.size();
+  int num_workers = std::min( gb_threads, num_images );
+  std::vector<tesseract::TessBaseAPI*> apis = { work.tessApi };
+  apis.insert( apis.end(), gb_worker_apis.begin(), gb_worker_apis.begin()+(num_workers-1) );
+
+  /// The worker instances start the document as the main one ///
+  if ( gb_adaptive_reset != RESET_NEVER )
+    for ( int w=1; w<num_workers; w++ )
+      apis[w]->ClearAdaptiveClassifier();
+
+  /// Private page xml of each page with a copy of its Page element ///
+  std::vector<PageWork> works( num_images );
+  std::vector< std::unique_ptr<PageXML> > pages( num_images );
+  std::vector<NamedImage> page_images = images;
+  std::vector<int> pagenums( num_images );
+  for ( int n=0; n<num_images; n++ ) {
+    xmlNodePtr xpg = page.closest( "Page", images[n].node );
+    pagenums[n] = 1+page.getPageNumber(xpg);
+    pages[n].reset( new PageXML );
+    xmlNodePtr priv = pages[n]->newXml( tool_info, page.getAttr( xpg, "imageFilename" ).c_str(), (int)page.getPageWidth(xpg), (int)page.getPageHeight(xpg), gb_page_ns );
+    page_images[n].node = replaceByCopy( pages[n]->closest( "Page", priv ), xpg );
+    if ( page_images[n].node == NULL ) {
+      logError( "problems preparing page %d for parallel recognition", pagenums[n] );
+      return 1;
+    }
+    works[n].page = pages[n].get();
+    attachDocDict( pages[n]->getDocPtr() );
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int next = 0;
+  bool failed = false;
+  std::vector<int> status( num_images, 0 );
+
+  auto worker = [&]( tesseract::TessBaseAPI* api ) {
+    for ( int processed=0; ; processed++ ) {
+      int n;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if ( failed || next >= num_images )
+          return;
+        n = next++;
+      }
+      if ( gb_adaptive_reset == RESET_PAGE && processed > 0 )
+        api->ClearAdaptiveClassifier();
+      works[n].tessApi = api;
+      auto mem_image = mem_images.find(n);
+      int r = 1;
+      try {
+        r = processImage( works[n], page_images[n], 0, pagenums[n], true, mem_image == mem_images.end() ? NULL : mem_image->second, false, num_pages, log_doc );
+      } catch ( const std::exception& e ) {
+        logError( "problems recognizing page %d: %s", pagenums[n], e.what() );
+      }
+      if ( works[n].douts_page != NULL )
+        directPageEnd( works[n].douts );
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        status[n] = r ? -1 : 1;
+        failed = failed || r;
+      }
+      cond.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for ( int w=0; w<num_workers; w++ )
+    threads.push_back( std::thread( worker, apis[w] ) );
+
+  /// Merge the pages in order as they finish, releasing the private page xmls ///
+  for ( int n=0; n<num_images; n++ ) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait( lock, [&]{ return status[n] != 0 || failed; } );
+      if ( status[n] != 1 )
+        break;
+    }
+    if ( ! mergePageWork( work, works[n], images[n], page_images[n].node ) ) {
+      logError( "problems merging page %d", pagenums[n] );
+      std::lock_guard<std::mutex> lock(mutex);
+      failed = true;
+      break;
+    }
+    pages[n].reset();
+  }
+
+  for ( auto& thread : threads )
+    thread.join();
+  return failed ? 1 : 0;
+}
+
+/**
+ * Processes a list of inputs producing a single Page XML.
+ *
+ * @param tessApi     Initialized tesseract instance.
+ * @param inputs      Inputs to process.
+ * @param output      Path where to write the Page XML, and base for the paths of other outputs.
+ * @param contents    If not NULL, outputs are stored here by path instead of written.
+ * @return            0 on success, 1 on failure.
+ */
+int processInputs( tesseract::TessBaseAPI* tessApi, const std::vector<InputFile>& inputs, const char* output, std::map<std::string,std::string>* contents = NULL ) {
+  int n, m;
+  PageXML page;
+  int num_pages = 0;
+  bool pixRelease = false;
+  std::vector<NamedImage> images;
+  std::vector<ShmImage> shm_images;
+
+  std::regex reIsXml(".+\\.xml$|^-$",std::regex_constants::icase);
+  std::regex reIsTiff(".+\\.tif{1,2}(|\\[[-, 0-9]+\\])$",std::regex_constants::icase);
+  std::regex reIsPdf(".+\\.pdf(|\\[[-, 0-9]+\\])$",std::regex_constants::icase);
+  std::regex reImagePageNum("(.+)\\[([-, 0-9]+)\\]$");
+  std::regex reIsShm("^shm:.+");
+  std::cmatch base_match;
+  const char *input_file = NULL;
+  bool input_xml = false;
+  std::map<int,const InputFile*> mem_images;
+
+  /// Release resources on every return path ///
+  ScopeExit release( [&]() {
+    for ( n=0; n<(int)shm_images.size(); n++ )
+      shmReleaseImage( shm_images[n] );
+    if ( pixRelease )
+      for ( n=0; n<(int)images.size(); n++ )
+        pixDestroy(&(images[n].image));
+  } );
+
+  /// Loop through input files ///
+  for ( m=0; m<(int)inputs.size(); m++ ) {
+    input_file = inputs[m].name.c_str();
+    bool input_mem = ! inputs[m].data.empty();
+    bool input_shm = ! input_mem && std::regex_match(input_file,reIsShm);
+    input_xml = ! input_shm && std::regex_match(input_file,base_match,reIsXml);
+    bool input_tiff = ! input_shm && std::regex_match(input_file,base_match,reIsTiff);
+    bool input_pdf = ! input_shm && std::regex_match(input_file,base_match,reIsPdf);
+
+    /// Get selected pages for tiff/pdf if given ///
+    std::set<int> pages_set;
+    std::string page_sel;
+    std::string input_file_str = std::string(input_file);
+    if ( input_tiff || input_pdf ) {
+      if( std::regex_match(input_file, base_match, reImagePageNum) ) {
+        pages_set = parsePagesSet(base_match[2].str());
+        page_sel = std::string(base_match[2].str());
+        input_file_str = std::string(base_match[1].str());
+      }
+    }
+
+    if ( input_mem && ( input_xml || input_pdf ) ) {
+      logError( "xml and pdf inputs only supported as files: %s", input_file );
+      return 1;
+    }
+
+    /// Input is xml ///
+    if ( input_xml ) {
+      if ( num_pages > 0 ) {
+        logError( "only a single page xml allowed as input" );
+        return 1;
+      }
+      try {
+        page.loadXml( input_file ); // if input_file is "-" xml is read from stdin
+      } catch ( const std::exception& e ) {
+        logError( "problems reading xml file: %s\n%s", input_file, e.what() );
+        return 1;
+      }
+      if ( gb_image != NULL ) {
+        if ( page.count("//_:Page") > 1 ) {
+          logError( "specifying image with multipage xml input not supported" );
+          return 1;
+        }
+        page.loadImage( 0, gb_image );
+      }
+      num_pages += page.count("//_:Page");
+
+      if ( gb_psm == tesseract::PSM_AUTO_OSD && page.count("//_:ImageOrientation") > 0 ) {
+        logError( "refusing to use OSD on page xml that already contains ImageOrientation elements" );
+        return 1;
+      }
+
+      std::vector<xmlNodePtr> sel = page.select(gb_xpath);
+      int selPages = 0;
+      for ( n=0; n<(int)sel.size(); n++ )
+        if ( page.nodeIs( sel[n], "Page" ) )
+          selPages++;
+      if ( selPages > 0 && selPages != (int)sel.size() ) {
+        logError( "xpath can select Page or non-Page elements but not a mixture of both: %s", gb_xpath );
+        return 1;
+      }
+
+      if ( selPages == 0 ) {
+        pixRelease = true;
+        images = page.crop( (std::string(gb_xpath)+"/_:Coords").c_str(), NULL, false );
+        page.releaseImages();
+      }
+      else {
+        for ( n=0; n<(int)sel.size(); n++ ) {
+          NamedImage namedimage;
+          namedimage.image = NULL;
+          namedimage.node = sel[n];
+          images.push_back( namedimage );
+          num_pages++;
+        }
+      }
+    }
+
+    /// Input is tiff image ///
+    else if ( input_tiff ) {
+      pixRelease = true;
+
+      /// Read input image ///
+      PIXA* tiffimage = input_mem ?
+        pixaReadMemMultipageTiff( inputs[m].data.data(), inputs[m].data.size() ) :
+        pixaReadMultipageTiff( input_file_str.c_str() );
+      if ( tiffimage == NULL || tiffimage->n == 0 ) {
+        logError( "problems reading tiff image: %s", input_file );
+        pixaDestroy(&tiffimage);
+        return 1;
+      }
+
+      if ( pages_set.size() > 0 && tiffimage->n <= *pages_set.rbegin() ) {
+        logError( "invalid page selection (%s) on tiff with %d pages", page_sel.c_str(), tiffimage->n+1 );
+        pixaDestroy(&tiffimage);
+        return 1;
+      }
+
+      for ( n=0; n<tiffimage->n; n++ ) {
+        if ( pages_set.size() > 0 && pages_set.find(n) == pages_set.end() )
+          continue;
+
+        PageImage image = pixClone(tiffimage->pix[n]);
+        std::string pagepath = input_file_str+"["+std::to_string(n)+"]";
+        NamedImage namedimage;
+        namedimage.image = image;
+        if ( num_pages == 0 )
+          namedimage.node = page.newXml( tool_info, pagepath.c_str(), pixGetWidth(image), pixGetHeight(image), gb_page_ns );
+        else
+          namedimage.node = page.addPage( pagepath.c_str(), pixGetWidth(image), pixGetHeight(image) );
+        images.push_back( namedimage );
+        num_pages++;
+      }
+
+      pixaDestroy(&tiffimage);
+    }
+
+    /// Input is pdf ///
+    else if ( input_pdf ) {
+      std::vector< std::pair<double,double> > pdf_pages = gsGetPdfPageSizes(input_file_str);
+      if ( pages_set.size() > 0 && (int)pdf_pages.size() <= *pages_set.rbegin() ) {
+        logError( "invalid page selection (%s) on pdf with %d pages", page_sel.c_str(), (int)pdf_pages.size() );
+        return 1;
+      }
+
+      for ( n=0; n<(int)pdf_pages.size(); n++ ) {
+        if ( pages_set.size() > 0 && pages_set.find(n) == pages_set.end() )
+          continue;
+
+        std::string pagepath = input_file_str+"["+std::to_string(n)+"]";
+        NamedImage namedimage;
+        namedimage.image = NULL;
+        if ( num_pages == 0 )
+          namedimage.node = page.newXml( tool_info, pagepath.c_str(), (int)(0.5+pdf_pages[n].first), (int)(0.5+pdf_pages[n].second), gb_page_ns );
+        else
+          namedimage.node = page.addPage( pagepath.c_str(), (int)(0.5+pdf_pages[n].first), (int)(0.5+pdf_pages[n].second) );
+        images.push_back( namedimage );
+        num_pages++;
+      }
+    }
+
+    /// Input is decoded image in shared memory ///
+    else if ( input_shm ) {
+      pixRelease = true;
+
+      ShmImage shm;
+      PageImage image = shmOpenImage( input_file+4, shm );
+      if ( image == NULL )
+        return 1;
+      shm_images.push_back( shm );
+
+      NamedImage namedimage;
+      namedimage.image = image;
+      if ( num_pages == 0 )
+        namedimage.node = page.newXml( tool_info, input_file, pixGetWidth(image), pixGetHeight(image), gb_page_ns );
+      else
+        namedimage.node = page.addPage( input_file, pixGetWidth(image), pixGetHeight(image) );
+      images.push_back( namedimage );
+      num_pages++;
+    }
+
+    /// Input is image ///
+    else {
+      /// Read input image, in-memory ones only decoded when recognized ///
+      l_int32 width, height;
+      PageImage image = NULL;
+      if ( input_mem ) {
+        if ( pixReadHeaderMem( inputs[m].data.data(), inputs[m].data.size(), NULL, &width, &height, NULL, NULL, NULL ) ) {
+          logError( "problems reading image: %s", input_file );
+          return 1;
+        }
+        mem_images[(int)images.size()] = &inputs[m];
+      }
+      else {
+        image = pixRead( input_file );
+        if ( image == NULL ) {
+          logError( "problems reading image: %s", input_file );
+          return 1;
+        }
+        width = pixGetWidth(image);
+        height = pixGetHeight(image);
+      }
+
+      NamedImage namedimage;
+      namedimage.image = NULL;
+      if ( num_pages == 0 )
+        namedimage.node = page.newXml( tool_info, input_file, width, height, gb_page_ns );
+      else
+        namedimage.node = page.addPage( input_file, width, height );
+      num_pages++;
+      pixDestroy(&image);
+      images.push_back( namedimage );
+    }
+  }
+
+  page.processStart(tool_info);
+
+  /// Intern the names of the elements and attributes created from now on ///
+  attachDocDict( page.getDocPtr() );
+
+  PageWork work;
+  work.tessApi = tessApi;
+  work.page = &page;
+  DirectOutputs& douts = work.douts;
+  if ( gb_tsv != NULL )
+    douts.tsv = "page\tlevel\tid\tleft\ttop\twidth\theight\tconf\ttext\n";
+  DocumentSummary& summary = work.summary;
+  GlyphSidecar& sidecar = work.sidecar;
+  std::string glyphs_bin;
+
+  /// Do not let the adaptation to previous documents affect this one ///
+  if ( gb_adaptive_reset != RESET_NEVER )
+    tessApi->ClearAdaptiveClassifier();
+
+  std::string log_doc = inputs.size() == 1 ? inputs[0].name : std::string(output);
+  logContext( log_doc, 0 );
+
+  /// Recognize the pages in parallel, each one in a private page xml merged in order ///
+  if ( gb_threads > 1 && ! input_xml && images.size() > 1 ) {
+    if ( processImagesParallel( work, images, mem_images, num_pages, log_doc ) )
+      return 1;
+  }
+
+  /// Otherwise loop through all images to process ///
+  else
+    for ( n=0; n<(int)images.size(); n++ ) {
+      xmlNodePtr xpg = page.closest( "Page", images[n].node );
+      bool page_end = n+1 == (int)images.size() || page.closest( "Page", images[n+1].node ) != xpg;
+      std::map<int,const InputFile*>::iterator mem_image = mem_images.find(n);
+      if ( processImage( work, images[n], n, 1+page.getPageNumber(xpg), page_end, mem_image == mem_images.end() ? NULL : mem_image->second, input_xml, num_pages, log_doc ) )
+        return 1;
+    }
+  if ( work.douts_page != NULL )
+    directPageEnd( douts );
+  logContext( log_doc, 0 );
+
+  /// Post-process the pages of the document not processed in the loop ///
+  std::vector<xmlNodePtr> sel = page.select("//_:Page");
+  for ( n=(int)sel.size()-1; n>=0; n-- )
+    if ( work.postprocessed.find(sel[n]) == work.postprocessed.end() )
+      postprocessPage( page, sel[n] );
+
+  /// Try to make imageFilename be a relative path w.r.t. the output XML, not for archive members ///
+  if ( ! input_xml && ! gb_inplace && ( contents == NULL || gb_output_archive == NULL ) && strcmp(output,"-") )
+    page.relativizeImageFilename(output);
+
+  /// Write resulting XML ///
+  int bytes = 1;
+  if ( gb_xml && contents != NULL ) {
+    std::string& xml = (*contents)[output];
+    xml = page.toString();
+    bytes = (int)xml.size();
+  }
+  else if ( gb_xml )
+    bytes = page.write( gb_inplace ? inputs[0].name.c_str() : output );
+  if ( bytes <= 0 )
+    logError( "problems writing to output xml: %s", output );
+
+  /// Write outputs produced directly from the iterator walk ///
+  if ( gb_alto != NULL )
+    douts.alto = altoHeader( inputs.size() == 1 ? inputs[0].name : std::string() ) + douts.alto + "</Layout>\n</alto>\n";
+  if ( gb_hocr != NULL )
+    douts.hocr = hocrHeader() + douts.hocr + "</body>\n</html>\n";
+  if ( gb_glyphs != NULL )
+    glyphs_bin = sidecarSerialize( sidecar );
+  std::string summary_json;
+  if ( gb_summary != NULL )
+    summary_json = summaryJson( summary, inputs.size() == 1 ? inputs[0].name : std::string(output) );
+  std::vector< std::pair<const char*,std::string*> > formats = {
+    { gb_text, &douts.text },
+    { gb_tsv, &douts.tsv },
+    { gb_alto, &douts.alto },
+    { gb_hocr, &douts.hocr },
+    { gb_glyphs, &glyphs_bin },
+    { gb_summary, &summary_json } };
+  for ( auto& format : formats ) {
+    if ( format.first == NULL )
+      continue;
+    std::string path = formatPath( format.first, output );
+    if ( contents != NULL )
+      (*contents)[path].swap( *format.second );
+    else if ( ! writeFile( path, *format.second ) ) {
+      logError( "problems writing output: %s", path.c_str() );
+      bytes = 0;
+    }
+  }
+
+  return bytes <= 0 ? 1 : 0;
+}
+
+/**
+ * Processes a list of inputs writing the Page XML at a relative path of the output directory or archive.
+ *
+ * @param tessApi      Initialized tesseract instance.
+ * @param inputs       Inputs to process.
+ * @param relpath      Relative path of the output Page XML.
+ * @param out_archive  If not NULL, archive where to write instead of the output directory.
+ * @param contents     If not NULL, outputs are stored here by their path in the output directory instead of written.
+ * @return             0 on success, 1 on failure.
+ */
+int processInputsTo( tesseract::TessBaseAPI* tessApi, const std::vector<InputFile>& inputs, const std::string& relpath, struct archive* out_archive, std::map<std::string,std::string>* contents = NULL ) {
+#ifdef __TESSREC_LIBARCHIVE__
+  if ( out_archive != NULL ) {
+    std::map<std::string,std::string> contents;
+    if ( processInputs( tessApi, inputs, relpath.c_str(), &contents ) )
+      return 1;
+    for ( auto& content : contents )
+      if ( ! archiveWriteMember( out_archive, content.first, content.second ) )
+        return 1;
+    return 0;
+  }
+#else
+  (void)out_archive;
+#endif
+
+  std::string output = std::string(gb_output_dir) + "/" + relpath;
+  if ( ! makeDirs( output.substr( 0, output.rfind('/') ) ) ) {
+    logError( "unable to create output directory for: %s", output.c_str() );
+    return 1;
+  }
+  return processInputs( tessApi, inputs, output.c_str(), contents );
+}
+
+
+/**
+ * Reads a manifest file appending the inputs listed one per line, skipping empty lines and # comments.
+ */
+bool readManifest( const char* fname, std::vector<std::string>& args ) {
+  std::ifstream manifest( fname );
+  if ( ! manifest.is_open() ) {
+    logError( "unable to read manifest: %s", fname );
+    return false;
+  }
+  std::string line;
+  while ( std::getline( manifest, line ) ) {
+    line = std::regex_replace( line, std::regex("^\\s+|\\s+$"), "" );
+    if ( ! line.empty() && line[0] != '#' )
+      args.push_back( line );
+  }
+  return true;
+}
+
+/**
+ * Reads the inputs recorded as done in a progress file, empty set if it does not exist.
+ */
+std::set<std::string> readProgress( const char* fname ) {
+  std::set<std::string> done;
+  std::ifstream progress( fname );
+  std::string line;
+  while ( std::getline( progress, line ) )
+    if ( ! line.empty() )
+      done.insert( line );
+  return done;
+}
+
+/**
+ * 64-bit FNV-1a hash, unlike std::hash guaranteed to be the same on every node.
+ */
+uint64_t stableHash( const std::string& str ) {
+  uint64_t hash = 14695981039346656037ULL;
+  for ( unsigned char c : str ) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Shard of an input for --shard-by hash. The hash is of the relative path of
+ * its output, so that inputs that would produce the same output are in the
+ * same shard, and it only depends on the name, so inputs of other shards can
+ * be skipped without accessing them.
+ */
+int hashShard( const std::string& relpath ) {
+  return (int)( stableHash( xmlPathFor(relpath) ) % gb_shard_count );
+}
+
+/**
+ * Selects the inputs that belong to the shard of this process for --shard-by
+ * size, greedily assigning the largest remaining input to the least loaded
+ * shard. Every node computes the same disjoint split given the same inputs,
+ * without any coordination.
+ */
+std::vector<DiscoveredFile> selectShard( std::vector<DiscoveredFile> items ) {
+  std::vector<DiscoveredFile> selected;
+  std::sort( items.begin(), items.end(), []( const DiscoveredFile& a, const DiscoveredFile& b ) {
+    return a.size != b.size ? a.size > b.size : a.path < b.path; } );
+  std::vector<uint64_t> loads( gb_shard_count, 0 );
+  for ( auto& item : items ) {
+    int shard = (int)( std::min_element( loads.begin(), loads.end() ) - loads.begin() );
+    loads[shard] += 1 + item.size;
+    if ( shard == gb_shard_index )
+      selected.push_back( item );
+  }
+  return selected;
+}
+
+volatile sig_atomic_t gb_stop = 0;
+
+/// Seconds that present files in a watched directory must stay unchanged to be considered complete ///
+#define WATCH_SETTLE 1
+
+void stopHandler( int ) {
+  gb_stop = 1;
+}
+
+/**
+ * Watches a directory processing files as soon as they are completely written
+ * (or moved into it) and afterwards moving them to the done or failed directory.
+ * Files already present when starting are processed first. Runs until SIGINT or
+ * SIGTERM is received.
+ *
+ * @param tessApi  Initialized tesseract instance.
+ * @param dir      Directory to watch.
+ * @return         0 on clean stop, 1 on failure.
+ */
+int watchDirectory( tesseract::TessBaseAPI* tessApi, const std::string& dir ) {
+  std::string done_dir = gb_watch_done != NULL ? gb_watch_done : dir + "/done";
+  std::string failed_dir = gb_watch_failed != NULL ? gb_watch_failed : dir + "/failed";
+  if ( ! makeDirs( done_dir ) || ! makeDirs( failed_dir ) ) {
+    logError( "unable to create done/failed directories: %s %s", done_dir.c_str(), failed_dir.c_str() );
+    return 1;
+  }
+
+  int fd = inotify_init1( IN_CLOEXEC );
+  if ( fd < 0 || inotify_add_watch( fd, dir.c_str(), IN_CLOSE_WRITE|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF ) < 0 ) {
+    logError( "unable to watch directory: %s :: %s", dir.c_str(), strerror(errno) );
+    return 1;
+  }
+
+  struct sigaction action;
+  memset( &action, 0, sizeof(action) );
+  action.sa_handler = stopHandler;
+  sigaction( SIGINT, &action, NULL );
+  sigaction( SIGTERM, &action, NULL );
+
+  auto processFile = [&]( const std::string& name ) {
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if ( isExcluded( name ) || ! isIncluded( name ) || stat( path.c_str(), &st ) != 0 || ! S_ISREG(st.st_mode) )
+      return;
+    std::vector<InputFile> single(1);
+    single[0].name = path;
+    int failed = processInputsTo( tessApi, single, xmlPathFor(name), NULL );
+    std::string dest = ( failed ? failed_dir : done_dir ) + "/" + name;
+    if ( ! moveFile( path, dest ) )
+      logWarning( "unable to move %s to %s :: %s", path.c_str(), dest.c_str(), strerror(errno) );
+    logInfo( "%s: %s", failed ? "failed" : "done", path.c_str() );
+  };
+
+  /// Files whose size or modification time change are still being written, left for their IN_CLOSE_WRITE ///
+  auto processPresent = [&]() {
+    std::vector<std::string> names = listDirectory( dir );
+    std::vector<struct stat> before( names.size() );
+    for ( size_t n=0; n<names.size(); n++ )
+      if ( stat( (dir+"/"+names[n]).c_str(), &before[n] ) != 0 )
+        before[n].st_size = -1;
+    sleep( WATCH_SETTLE );
+    for ( size_t n=0; n<names.size() && ! gb_stop; n++ ) {
+      struct stat st;
+      if ( stat( (dir+"/"+names[n]).c_str(), &st ) != 0 )
+        continue;
+      if ( st.st_size != before[n].st_size ||
+           st.st_mtim.tv_sec != before[n].st_mtim.tv_sec ||
+           st.st_mtim.tv_nsec != before[n].st_mtim.tv_nsec ) {
+        logInfo( "still being written, waiting for it to be closed: %s/%s", dir.c_str(), names[n].c_str() );
+        continue;
+      }
+      processFile( names[n] );
+    }
+  };
+
+  logInfo( "watching directory: %s", dir.c_str() );
+  processPresent();
+
+  int rc = 0;
+  char buf[ 64 * ( sizeof(struct inotify_event) + NAME_MAX + 1 ) ] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while ( ! gb_stop ) {
+    ssize_t len = read( fd, buf, sizeof(buf) );
+    if ( len < 0 ) {
+      if ( errno == EINTR )
+        continue;
+      logError( "problems reading inotify events :: %s", strerror(errno) );
+      rc = 1;
+      break;
+    }
+    for ( char* ptr = buf; ptr < buf+len && ! gb_stop; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len ) {
+      struct inotify_event* event = (struct inotify_event*)ptr;
+      if ( event->mask & IN_Q_OVERFLOW )
+        processPresent();
+      else if ( event->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) ) {
+        logError( "watched directory removed: %s", dir.c_str() );
+        rc = 1;
+        gb_stop = 1;
+      }
+      else if ( event->len > 0 && ! ( event->mask & IN_ISDIR ) )
+        processFile( event->name );
+    }
+  }
+
+  close( fd );
+  logInfo( "stopped watching directory: %s", dir.c_str() );
+  return rc;
+}
+
+/**
+ * Worker that takes jobs from a spool directory shared by many processes,
+ * possibly on different nodes over NFS. A job is a file in SPOOL/pending that
+ * lists inputs like a manifest, and its result is a single Page XML written to
+ * the output directory. Jobs are claimed by atomically renaming them to
+ * SPOOL/running/JOB@WORKER, whose modification time is refreshed as heartbeat
+ * while processing, and end up in SPOOL/done or SPOOL/failed. Running jobs with
+ * a heartbeat older than --queue-stale seconds, i.e. of crashed workers, are
+ * moved back to pending. The worker exits when no jobs are pending or running,
+ * or on SIGINT or SIGTERM after finishing the current job.
+ *
+ * @param tessApi  Initialized tesseract instance.
+ * @param spool    Spool directory.
+ * @return         0 if all jobs processed by this worker succeeded, 1 otherwise.
+ */
+int queueWorker( tesseract::TessBaseAPI* tessApi, const std::string& spool ) {
+  std::string pending_dir = spool + "/pending";
+  std::string running_dir = spool + "/running";
+  std::string done_dir = spool + "/done";
+  std::string failed_dir = spool + "/failed";
+  if ( ! makeDirs( pending_dir ) || ! makeDirs( running_dir ) || ! makeDirs( done_dir ) || ! makeDirs( failed_dir ) ) {
+    logError( "unable to create spool directories in: %s", spool.c_str() );
+    return 1;
+  }
+
+  char hostname[256] = "localhost";
+  gethostname( hostname, sizeof(hostname)-1 );
+  std::string worker = std::string(hostname) + "." + std::to_string(getpid());
+  int heartbeat = std::max( 1, gb_queue_stale/10 );
+
+  struct sigaction action;
+  memset( &action, 0, sizeof(action) );
+  action.sa_handler = stopHandler;
+  sigaction( SIGINT, &action, NULL );
+  sigaction( SIGTERM, &action, NULL );
+
+  /// Moves stale running jobs back to pending, returns number of jobs still running ///
+  /// The current time is that of a file touched in the spool, so clocks of the nodes can differ ///
+  std::string clock_file = spool + "/.clock";
+  auto reclaimStale = [&]() {
+    int running = 0;
+    struct stat st;
+    int clock_fd = open( clock_file.c_str(), O_WRONLY|O_CREAT|O_CLOEXEC, 0666 );
+    if ( clock_fd >= 0 )
+      close( clock_fd );
+    time_t now = clock_fd >= 0 && utimensat( AT_FDCWD, clock_file.c_str(), NULL, 0 ) == 0 &&
+                 stat( clock_file.c_str(), &st ) == 0 ? st.st_mtime : time(NULL);
+    for ( auto& name : listDirectory( running_dir ) ) {
+      std::string path = running_dir + "/" + name;
+      if ( stat( path.c_str(), &st ) != 0 )
+        continue;
+      running++;
+      if ( now - st.st_mtime < gb_queue_stale || name.rfind('@') == std::string::npos )
+        continue;
+      std::string job = name.substr( 0, name.rfind('@') );
+      if ( rename( path.c_str(), (pending_dir+"/"+job).c_str() ) == 0 ) {
+        logWarning( "reclaimed stale job: %s", name.c_str() );
+        running--;
+      }
+    }
+    return running;
+  };
+
+  int failed = 0;
+  logInfo( "worker %s processing jobs from: %s", worker.c_str(), spool.c_str() );
+  while ( ! gb_stop ) {
+    /// Claim the first pending job that no other worker takes before ///
+    std::string job, claimed;
+    for ( auto& name : listDirectory( pending_dir ) ) {
+      std::string path = running_dir + "/" + name + "@" + worker;
+      if ( rename( (pending_dir+"/"+name).c_str(), path.c_str() ) == 0 ) {
+        /// Rename keeps the time the job was submitted, it would look stale to other workers ///
+        utimensat( AT_FDCWD, path.c_str(), NULL, 0 );
+        job = name;
+        claimed = path;
+        break;
+      }
+    }
+
+    if ( job.empty() ) {
+      if ( reclaimStale() == 0 && listDirectory( pending_dir ).empty() )
+        break;
+      sleep( std::min( 10, heartbeat ) );
+      continue;
+    }
+
+    /// Heartbeat while processing ///
+    std::mutex mtx;
+    std::condition_variable cond;
+    bool finished = false;
+    std::thread beat( [&]() {
+      std::unique_lock<std::mutex> lock(mtx);
+      while ( ! cond.wait_for( lock, std::chrono::seconds(heartbeat), [&]{ return finished; } ) )
+        utimensat( AT_FDCWD, claimed.c_str(), NULL, 0 );
+    } );
+
+    std::vector<std::string> args;
+    std::vector<InputFile> inputs;
+    int r = readManifest( claimed.c_str(), args ) ? 0 : 1;
+    for ( auto& arg : args ) {
+      InputFile input;
+      input.name = arg;
+      inputs.push_back( input );
+    }
+    if ( r == 0 && inputs.size() == 0 ) {
+      logError( "job without inputs: %s", job.c_str() );
+      r = 1;
+    }
+    std::map<std::string,std::string> contents;
+    if ( r == 0 )
+      r = processInputsTo( tessApi, inputs, xmlPathFor(job), NULL, &contents );
+
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      finished = true;
+    }
+    cond.notify_all();
+    beat.join();
+
+    /// Outputs are written to temporary names, and only moved into place if the claim is still ours ///
+    std::vector< std::pair<std::string,std::string> > temps;
+    for ( auto& content : contents ) {
+      if ( content.first == "-" )
+        continue;
+      std::string temp = content.first + ".tmp-" + worker;
+      if ( ! writeFile( temp, content.second ) ) {
+        logError( "problems writing output: %s", content.first.c_str() );
+        unlink( temp.c_str() );
+        r = 1;
+        continue;
+      }
+      temps.push_back( std::make_pair( temp, content.first ) );
+    }
+
+    /// Refreshing the heartbeat fails if the job was reclaimed, otherwise it can not be for a while ///
+    if ( utimensat( AT_FDCWD, claimed.c_str(), NULL, 0 ) != 0 ) {
+      for ( auto& temp : temps )
+        unlink( temp.first.c_str() );
+      logWarning( "job was reclaimed by another worker while processing, discarding its output: %s", job.c_str() );
+      continue;
+    }
+    for ( auto& temp : temps ) {
+      if ( r == 0 && rename( temp.first.c_str(), temp.second.c_str() ) == 0 )
+        continue;
+      if ( r == 0 )
+        logError( "unable to move output into place: %s :: %s", temp.second.c_str(), strerror(errno) );
+      unlink( temp.first.c_str() );
+      r = 1;
+    }
+    if ( r == 0 && contents.find("-") != contents.end() )
+      writeFile( "-", contents["-"] );
+    failed += r;
+
+    std::string dest = ( r ? failed_dir : done_dir ) + "/" + job;
+    if ( rename( claimed.c_str(), dest.c_str() ) != 0 )
+      logWarning( "unable to move job to %s: %s :: %s", r ? "failed" : "done", job.c_str(), strerror(errno) );
+    logInfo( "%s: %s", r ? "failed" : "done", job.c_str() );
+  }
+
+  return failed ? 1 : 0;
+}
+
+/**
+ * Initializes a tesseract instance for a language. Init only variables, such
+ * as the dawgs to load, need to be given to Init.
+ *
+ * @param api   Tesseract instance.
+ * @param lang  Language to load.
+ * @param vars  Tesseract variables.
+ * @return      0 on success, -1 on failure as TessBaseAPI::Init.
+ */
+int initTesseractLang( tesseract::TessBaseAPI* api, const char* lang, const std::vector< std::pair<std::string,std::string> >& vars ) {
+#if TESSERACT_VERSION >= 0x050000
+  std::vector<std::string> vars_vec, vars_values;
+#elif TESSERACT_VERSION >= 0x040000
+  GenericVector<STRING> vars_vec, vars_values;
+#endif
+#if TESSERACT_VERSION >= 0x040000
+  for ( auto& var : vars ) {
+    vars_vec.push_back( var.first.c_str() );
+    vars_values.push_back( var.second.c_str() );
+  }
+  return api->Init( gb_tessdata, lang, (tesseract::OcrEngineMode)gb_oem, NULL, 0, &vars_vec, &vars_values, false );
+#else
+  (void)vars;
+  return api->Init( gb_tessdata, lang );
+#endif
+}
+
+/**
+ * Creates and initializes a tesseract instance with the configuration given
+ * on the command line, just for layout or with the language.
+ *
+ * @param vars  Tesseract variables, the ones that are not for init set after Init.
+ * @param warn  Whether to warn about unknown variables.
+ * @return      The instance, NULL on failure.
+ */
+tesseract::TessBaseAPI* initTesseract( const std::vector< std::pair<std::string,std::string> >& vars, bool warn ) {
+  tesseract::TessBaseAPI* api = new tesseract::TessBaseAPI();
+  if ( gb_onlylayout && gb_psm != tesseract::PSM_AUTO_OSD )
+    api->InitForAnalysePage();
+  else if ( initTesseractLang( api, gb_lang, vars ) ) {
+    delete api;
+    return NULL;
+  }
+
+  /// Other variables are set after Init, failing only for init ones or if unknown ///
+  for ( auto& var : vars )
+    if ( ! api->SetVariable( var.first.c_str(), var.second.c_str() ) && warn ) {
+#if TESSERACT_VERSION >= 0x050000
+      std::string value;
+#else
+      STRING value;
+#endif
+      if ( ! api->GetVariableAsString( var.first.c_str(), &value ) )
+        logWarning( "unknown tesseract variable: %s", var.first.c_str() );
+    }
+
+  api->SetPageSegMode( (tesseract::PageSegMode)gb_psm );
+
+  /// Per character choices of the LSTM are only kept if requested ///
+  if ( gb_alternatives > 0 && ! gb_onlylayout && ! api->SetVariable( "lstm_choice_mode", "2" ) && warn )
+    logWarning( "tesseract without lstm_choice_mode, alternatives only from the legacy engine" );
+
+  return api;
+}
+
+/**
+ * Ends the main, the workers and the extra languages tesseract instances.
+ */
+void endTesseract( tesseract::TessBaseAPI* tessApi ) {
+  for ( auto& extra : gb_extra_apis ) {
+    extra.second->End();
+    delete extra.second;
+  }
+  gb_extra_apis.clear();
+  for ( auto& worker : gb_worker_apis ) {
+    worker->End();
+    delete worker;
+  }
+  gb_worker_apis.clear();
+  tessApi->End();
+  delete tessApi;
+}
+
+/*** Program ******************************************************************/
+int main( int argc, char *argv[] ) {
+
+  /// Disable debugging and informational messages from Leptonica. ///
+  setMsgSeverity(L_SEVERITY_ERROR);
+
+  /// Parse input arguments ///
+  int n,m;
+  std::stringstream test;
+  std::string token;
+  char trailing;
+  while ( ( n = getopt_long(argc,argv,gb_short_options,gb_long_options,&m) ) != -1 )
+    switch ( n ) {
+      case OPTION_TESSDATA:
+        gb_tessdata = optarg;
+        break;
+      case OPTION_LANG:
+        gb_lang = optarg;
+        break;
+      case OPTION_PSM:
+        gb_psm = atoi(optarg);
+        if( gb_psm < tesseract::PSM_AUTO_OSD || gb_psm == tesseract::PSM_AUTO_ONLY || gb_psm >= tesseract::PSM_COUNT ) {
+          logError( "invalid page segmentation mode: %s", optarg );
+          return 1;
+        }
+        break;
+#if TESSERACT_VERSION >= 0x040000
+      case OPTION_OEM:
+        gb_oem = atoi(optarg);
+        if( gb_oem < tesseract::OEM_TESSERACT_ONLY || gb_oem >= tesseract::OEM_COUNT ) {
+          logError( "invalid OCR engine mode: %s", optarg );
+          return 1;
+        }
+        break;
+#endif
+      case OPTION_PROFILE:
+        gb_profile = optarg;
+        if ( parseProfile(optarg) == -1 ) {
+          logError( "invalid profile: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_ADAPTIVERESET:
+        gb_adaptive_reset = parseReset(optarg);
+        if ( gb_adaptive_reset == -1 ) {
+          logError( "invalid adaptive reset: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_SET:
+        if ( strchr(optarg,'=') == NULL || optarg[0] == '=' ) {
+          logError( "expected VAR=VALUE for --set: %s", optarg );
+          return 1;
+        }
+        gb_vars.push_back( std::make_pair( std::string(optarg,strchr(optarg,'=')-optarg), std::string(strchr(optarg,'=')+1) ) );
+        break;
+      case OPTION_LAYOUTLEVEL:
+        gb_layoutlevel = parseLevel(optarg);
+        if( gb_layoutlevel == -1 ) {
+          logError( "invalid level: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_TEXTLEVELS:
+        test = std::stringstream(optarg);
+        while( std::getline(test, token, ',') ) {
+          int textlevel = parseLevel(token.c_str());
+          if( textlevel == -1 ) {
+            logError( "invalid level: %s", token.c_str() );
+            return 1;
+          }
+          gb_textlevels[textlevel] = true;
+          gb_textatlayout = false;
+        }
+        break;
+      case OPTION_ONLYLAYOUT:
+        gb_onlylayout = true;
+        break;
+      case OPTION_TEXTBLOCKS:
+        gb_text_blocks = true;
+        break;
+      case OPTION_NONTEXTREGIONS:
+        gb_nontext_regions = true;
+        break;
+      case OPTION_EXTRALANGS:
+        gb_extra_langs = optarg;
+        break;
+      case OPTION_MINCONF:
+        {
+          char* end;
+          gb_min_conf = strtod( optarg, &end );
+          if ( end == optarg || *end != '\0' || ! ( gb_min_conf >= 0.0 && gb_min_conf <= 1.0 ) ) {
+            logError( "invalid confidence for --min-conf, expected in [0,1]: %s", optarg );
+            return 1;
+          }
+        }
+        break;
+      case OPTION_MINCONFLEVEL:
+        gb_min_conf_level = parseLevel(optarg);
+        if( gb_min_conf_level != LEVEL_LINE && gb_min_conf_level != LEVEL_WORD ) {
+          logError( "invalid level for --min-conf: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_MINCONFFLAG:
+        gb_min_conf_flag = true;
+        break;
+      case OPTION_SAVECROPS:
+        gb_save_crops = true;
+        break;
+      case OPTION_XPATH:
+        gb_xpath = optarg;
+        break;
+      case OPTION_IMAGE:
+        gb_image = optarg;
+        break;
+      case OPTION_DENSITY:
+        gb_density = atoi(optarg);
+        break;
+      case OPTION_INPLACE:
+        gb_inplace = true;
+        break;
+      case OPTION_OUTPUT:
+        gb_output = optarg;
+        break;
+      case OPTION_INCLUDE:
+        gb_include.push_back( optarg );
+        break;
+      case OPTION_EXCLUDE:
+        gb_exclude.push_back( optarg );
+        break;
+      case OPTION_MANIFEST:
+        gb_manifest = optarg;
+        break;
+      case OPTION_SHARD:
+        if ( sscanf( optarg, "%d/%d%c", &gb_shard_index, &gb_shard_count, &trailing ) != 2 ||
+             gb_shard_count < 1 || gb_shard_index < 0 || gb_shard_index >= gb_shard_count ) {
+          logError( "invalid shard, expected I/N with 0<=I<N: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_SHARDBY:
+        if ( strcmp(optarg,"hash") && strcmp(optarg,"size") ) {
+          logError( "invalid shard mode: %s", optarg );
+          return 1;
+        }
+        gb_shard_by_size = ! strcmp(optarg,"size");
+        break;
+      case OPTION_PROGRESS:
+        gb_progress = optarg;
+        break;
+      case OPTION_TEXT:
+        gb_text = optarg;
+        break;
+      case OPTION_TSV:
+        gb_tsv = optarg;
+        break;
+      case OPTION_ALTO:
+        gb_alto = optarg;
+        break;
+      case OPTION_HOCR:
+        gb_hocr = optarg;
+        break;
+      case OPTION_GLYPHS:
+        gb_glyphs = optarg;
+        break;
+      case OPTION_SUMMARY:
+        gb_summary = optarg;
+        break;
+      case OPTION_LOGJSON:
+        gb_log_json = true;
+        break;
+      case OPTION_REQUESTID:
+        gb_request_id = optarg;
+        break;
+      case OPTION_LOGREPEAT:
+        {
+          char* end;
+          long repeat = strtol( optarg, &end, 10 );
+          if ( end == optarg || *end != '\0' || repeat < 0 || repeat > INT_MAX ) {
+            logError( "invalid number of repeated warnings: %s", optarg );
+            return 1;
+          }
+          gb_log_repeat = (int)repeat;
+        }
+        break;
+      case OPTION_ALTERNATIVES:
+        {
+          char* end;
+          long alternatives = strtol( optarg, &end, 10 );
+          if ( end == optarg || *end != '\0' || alternatives < 0 || alternatives > INT_MAX ) {
+            logError( "invalid number of alternatives: %s", optarg );
+            return 1;
+          }
+          gb_alternatives = (int)alternatives;
+        }
+        break;
+      case OPTION_NOXML:
+        gb_xml = false;
+        break;
+      case OPTION_THREADS:
+        gb_threads = atoi(optarg);
+        break;
+      case OPTION_QUEUE:
+        gb_queue = optarg;
+        break;
+      case OPTION_QUEUESTALE:
+        gb_queue_stale = atoi(optarg);
+        if ( gb_queue_stale < 1 ) {
+          logError( "invalid queue stale time: %s", optarg );
+          return 1;
+        }
+        break;
+      case OPTION_WATCH:
+        gb_watch = optarg;
+        break;
+      case OPTION_WATCHDONE:
+        gb_watch_done = optarg;
+        break;
+      case OPTION_WATCHFAILED:
+        gb_watch_failed = optarg;
+        break;
+      case OPTION_OUTPUTDIR:
+        gb_output_dir = optarg;
+        break;
+      case OPTION_OUTPUTARCHIVE:
+#ifdef __TESSREC_LIBARCHIVE__
+        gb_output_archive = optarg;
+        break;
+#else
+        logError( "output archive requires compiling with libarchive" );
+        return 1;
+#endif
+      case OPTION_HELP:
+        print_usage();
+        return 0;
+      case OPTION_VERSION:
+        fprintf( stderr, "%s %s\n", tool, version+9 );
+        fprintf( stderr, "compiled against PageXML %s\n", PageXML::version() );
+#ifdef TESSERACT_VERSION_STR
+        fprintf( stderr, "compiled against tesseract %s, linked with %s\n", TESSERACT_VERSION_STR, tesseract::TessBaseAPI::Version() );
+#else
+        fprintf( stderr, "linked with tesseract %s\n", tesseract::TessBaseAPI::Version() );
+#endif
+        return 0;
+      default:
+        logError( "incorrect input argument: %s", argv[optind-1] );
+        return 1;
+    }
+
+  /// Default text level ///
+  if ( gb_textatlayout )
+    gb_textlevels[gb_layoutlevel] = true;
+
+  /// By default repeated warnings are only limited in JSON logs ///
+  if ( gb_log_repeat < 0 )
+    gb_log_repeat = gb_log_json ? 10 : 0;
+
+  if ( gb_extra_langs != NULL && ( gb_layoutlevel < LEVEL_LINE || ! gb_textlevels[LEVEL_LINE] ) ) {
+    logError( "--extra-langs requires line in the layout and text levels" );
+    return 1;
+  }
+  if ( gb_threads < 1 || ( gb_threads > 1 && gb_extra_langs != NULL ) ) {
+    logError( "--threads requires a positive number and does not support --extra-langs" );
+    return 1;
+  }
+
+  /// Check additional outputs ///
+  if ( gb_text_blocks && gb_psm != tesseract::PSM_AUTO && gb_psm != tesseract::PSM_SINGLE_COLUMN && gb_psm != tesseract::PSM_SPARSE_TEXT ) {
+    logError( "--text-blocks requires page segmentation mode %d, %d or %d", tesseract::PSM_AUTO, tesseract::PSM_SINGLE_COLUMN, tesseract::PSM_SPARSE_TEXT );
+    return 1;
+  }
+  if ( ( gb_alto != NULL || gb_hocr != NULL ) && gb_psm == tesseract::PSM_AUTO_OSD ) {
+    logError( "--alto and --hocr do not support page segmentation mode %d, their boxes are not rotated by the detected orientation", tesseract::PSM_AUTO_OSD );
+    return 1;
+  }
+  if ( gb_glyphs != NULL && gb_layoutlevel < LEVEL_WORD ) {
+    logError( "--glyphs requires layout level word or glyph" );
+    return 1;
+  }
+  if ( gb_alternatives > 0 && ( gb_onlylayout || ( ( gb_layoutlevel < LEVEL_GLYPH || ! gb_textlevels[LEVEL_GLYPH] ) && gb_glyphs == NULL ) ) ) {
+    logError( "--alternatives requires glyph in the layout and text levels or --glyphs, and no --only-layout" );
+    return 1;
+  }
+  const char* formats[] = { gb_text, gb_tsv, gb_alto, gb_hocr, gb_glyphs, gb_summary };
+  bool any_format = false;
+  bool all_ext = true;
+  bool any_ext = false;
+  for ( const char* format : formats )
+    if ( format != NULL ) {
+      any_format = true;
+      all_ext = all_ext && format[0] == '.';
+      any_ext = any_ext || format[0] == '.';
+    }
+  if ( ! gb_xml && ! any_format ) {
+    logError( "--no-xml requires --text, --tsv, --alto, --hocr, --glyphs or --summary" );
+    return 1;
+  }
+  if ( gb_output_dir != NULL || gb_output_archive != NULL || gb_watch != NULL || gb_queue != NULL ) {
+    if ( ! all_ext ) {
+      logError( "with output per input --text, --tsv, --alto, --hocr, --glyphs and --summary must be extensions starting with '.'" );
+      return 1;
+    }
+  }
+  else if ( ! strcmp(gb_output,"-") && any_ext ) {
+    logError( "--text, --tsv, --alto, --hocr, --glyphs and --summary extensions require an output file given with -o" );
+    return 1;
+  }
+
+  /// Inputs from arguments and manifest ///
+  std::vector<std::string> args( argv+optind, argv+argc );
+  if ( gb_manifest != NULL && ! readManifest( gb_manifest, args ) )
+    return 1;
+  bool per_input = gb_output_dir != NULL || gb_output_archive != NULL;
+
+  /// Check that there is at least one input or a directory to watch or a spool ///
+  if ( gb_watch != NULL || gb_queue != NULL ) {
+    if ( ( gb_watch != NULL && gb_queue != NULL ) || args.size() > 0 || gb_output_dir == NULL || gb_output_archive != NULL ) {
+      logError( "--watch and --queue require --output-dir and do not accept other inputs, each other or --output-archive" );
+      return 1;
+    }
+  }
+  else if ( args.size() == 0 ) {
+    logError( "at least one input file must be provided, see usage with --help" );
+    return 1;
+  }
+
+  /// Sharding and progress only for output per input to a directory, an archive would be rewritten by each shard and rerun ///
+  if ( ( gb_shard_count > 0 || gb_progress != NULL ) && ( gb_output_dir == NULL || gb_output_archive != NULL || gb_watch != NULL || gb_queue != NULL ) ) {
+    logError( "--shard and --progress require --output-dir and no --output-archive, --watch or --queue" );
+    return 1;
+  }
+  std::string default_progress;
+  if ( gb_shard_count > 0 && gb_progress == NULL ) {
+    if ( ! makeDirs( gb_output_dir ) ) {
+      logError( "unable to create output directory: %s", gb_output_dir );
+      return 1;
+    }
+    default_progress = std::string(gb_output_dir) + "/shard_" + std::to_string(gb_shard_index) + "_of_" + std::to_string(gb_shard_count) + ".progress";
+    gb_progress = (char*)default_progress.c_str();
+  }
+
+  /// Tesseract variables of the profile followed by the ones given with --set ///
+  std::vector< std::pair<std::string,std::string> > vars;
+  if ( gb_profile != NULL )
+    for ( const ProfileVariable& var : profileVariables )
+      if ( ! strcmp(var.profile,gb_profile) )
+        vars.push_back( std::make_pair( std::string(var.name), std::string(var.value) ) );
+  vars.insert( vars.end(), gb_vars.begin(), gb_vars.end() );
+
+  /// Initialize tesseract just for layout or with given language and tessdata path///
+  tesseract::TessBaseAPI *tessApi = initTesseract( vars, true );
+  if ( tessApi == NULL ) {
+    logError( "could not initialize tesseract" );
+    return 1;
+  }
+
+  /// Extra languages reusing the layout and thresholding of the main one ///
+  if ( gb_extra_langs != NULL && ! gb_onlylayout ) {
+    std::stringstream langs(gb_extra_langs);
+    std::string lang;
+    while ( std::getline( langs, lang, ',' ) ) {
+      tesseract::TessBaseAPI* extra = new tesseract::TessBaseAPI();
+      if ( initTesseractLang( extra, lang.c_str(), vars ) ) {
+        logError( "could not initialize tesseract for language: %s", lang.c_str() );
+        return 1;
+      }
+      extra->SetPageSegMode( tesseract::PSM_SINGLE_LINE );
+      gb_extra_apis.push_back( std::make_pair( lang, extra ) );
+    }
+  }
+
+  /// Additional instances for the workers that recognize pages in parallel ///
+  for ( int w=1; w<gb_threads; w++ ) {
+    tesseract::TessBaseAPI* worker = initTesseract( vars, false );
+    if ( worker == NULL ) {
+      logError( "could not initialize tesseract for worker %d", w );
+      return 1;
+    }
+    gb_worker_apis.push_back( worker );
+  }
+
+  /// Inplace only when single XML input and output not specified ///
+  std::regex reIsXml(".+\\.xml$|^-$",std::regex_constants::icase);
+  bool input_xml = args.size() > 0 && args[0].compare(0,4,"shm:") && std::regex_match(args[0],reIsXml);
+  if ( gb_inplace && ( ! input_xml || strcmp(gb_output,"-") || per_input ) ) {
+    logWarning( "ignoring --inplace option, output to %s", per_input ? "per input files" : gb_output );
+    gb_inplace = false;
+  }
+
+  /// Info for process element ///
+  if ( gb_onlylayout )
+    snprintf( tool_info, sizeof tool_info, "%s_v%.10s tesseract_v%s", tool, version+9, tesseract::TessBaseAPI::Version() );
+  else
+    snprintf( tool_info, sizeof tool_info, "%s_v%.10s tesseract_v%s lang=%s", tool, version+9, tesseract::TessBaseAPI::Version(), gb_lang );
+
+  /// Daemon mode keeping models loaded ///
+  if ( gb_watch != NULL ) {
+    int rc = watchDirectory( tessApi, std::regex_replace( std::string(gb_watch), std::regex("(.)/+$"), "$1" ) );
+    endTesseract( tessApi );
+    logContext( "", 0 );
+    return rc;
+  }
+  if ( gb_queue != NULL ) {
+    int rc = queueWorker( tessApi, std::regex_replace( std::string(gb_queue), std::regex("(.)/+$"), "$1" ) );
+    endTesseract( tessApi );
+    logContext( "", 0 );
+    return rc;
+  }
+
+  struct archive* out_archive = NULL;
+#ifdef __TESSREC_LIBARCHIVE__
+  if ( gb_output_archive != NULL && ( out_archive = archiveWriteOpen(gb_output_archive) ) == NULL )
+    return 1;
+#endif
+
+  /// Loop through inputs, if output per input only collected to be processed afterwards ///
+  std::vector<InputFile> inputs;
+  std::vector<DiscoveredFile> items;
+  std::vector<std::string> archives;
+#ifdef __TESSREC_LIBARCHIVE__
+  size_t archive_bytes = 0;
+#endif
+  int failed = 0;
+  for ( auto& arg : args ) {
+    const char *input_file = arg.c_str();
+
+    /// Input is archive, members streamed one at a time ///
+    if ( isArchiveName(arg) ) {
+      if ( per_input ) {
+        archives.push_back( arg );
+        continue;
+      }
+#ifdef __TESSREC_LIBARCHIVE__
+      std::string prefix = arg + "/";
+      int r = archiveReadMembers( input_file, [&]( InputFile& member ) {
+        member.name = prefix + member.name;
+        archive_bytes += member.data.size();
+        if ( archive_bytes > ARCHIVE_BUFFER_WARN && archive_bytes - member.data.size() <= ARCHIVE_BUFFER_WARN )
+          logWarning( "for a single output all archive members are kept in memory (over %d MiB), consider --output-dir or --output-archive: %s", (int)(ARCHIVE_BUFFER_WARN>>20), input_file );
+        inputs.push_back( std::move(member) );
+        return 0;
+      } );
+      failed += r < 0 ? 1 : r;
+#else
+      logError( "archive input requires compiling with libarchive: %s", input_file );
+      failed++;
+#endif
+      continue;
+    }
+
+    /// For sharding by hash the inputs of other shards are skipped before accessing them ///
+    if ( per_input && gb_shard_count > 0 && ! gb_shard_by_size && hashShard( arg.substr( arg.rfind('/')+1 ) ) != gb_shard_index )
+      continue;
+
+    /// Input is directory ///
+    struct stat st;
+    bool exists = stat( input_file, &st ) == 0;
+    if ( exists && S_ISDIR(st.st_mode) ) {
+      std::string dir = std::regex_replace( arg, std::regex("(.)/+$"), "$1" );
+      std::vector<DiscoveredFile> files = discoverFiles( dir );
+      if ( files.size() == 0 )
+        logWarning( "no files to process found in directory: %s", input_file );
+      for ( auto& file : files ) {
+        if ( per_input )
+          items.push_back( file );
+        else {
+          InputFile input;
+          input.name = file.path;
+          inputs.push_back( input );
+        }
+      }
+      continue;
+    }
+
+    if ( per_input ) {
+      DiscoveredFile file;
+      file.path = arg;
+      file.relpath = arg.substr( arg.rfind('/')+1 );
+      file.size = exists && S_ISREG(st.st_mode) ? st.st_size : 0;
+      items.push_back( file );
+    }
+    else {
+      InputFile input;
+      input.name = arg;
+      inputs.push_back( input );
+    }
+  }
+
+  /// Process all inputs into a single Page XML ///
+  if ( ! per_input ) {
+    if ( inputs.size() == 0 ) {
+      logError( "no images found in the given inputs" );
+      failed++;
+    }
+    else if ( failed == 0 )
+      failed += processInputs( tessApi, inputs, gb_output );
+  }
+
+  /// Process each input separately, only the ones of this shard not already done, largest first ///
+  else {
+    std::set<std::string> done;
+    FILE* progress = NULL;
+    if ( gb_progress != NULL ) {
+      done = readProgress( gb_progress );
+      if ( ( progress = fopen( gb_progress, "a" ) ) == NULL ) {
+        logError( "unable to open progress file: %s", gb_progress );
+        return 1;
+      }
+    }
+
+    /// Inputs that differ only in extension or directory input would overwrite each other's output ///
+    std::map<std::string,std::string> claimed;
+    auto claimOutput = [&]( const std::string& name, const std::string& relpath ) {
+      auto claim = claimed.insert( std::make_pair( xmlPathFor(relpath), name ) );
+      if ( ! claim.second && claim.first->second != name ) {
+        logError( "output %s of %s already produced by %s, skipping it", claim.first->first.c_str(), name.c_str(), claim.first->second.c_str() );
+        return false;
+      }
+      return true;
+    };
+    std::vector<DiscoveredFile> unique_items;
+    for ( auto& item : items ) {
+      if ( claimOutput( item.path, item.relpath ) )
+        unique_items.push_back( item );
+      else
+        failed++;
+    }
+    items.swap( unique_items );
+
+    /// For sharding by size archive members are listed, to be balanced together with the other inputs ///
+    std::set<std::string> members, shard_members;
+#ifdef __TESSREC_LIBARCHIVE__
+    if ( gb_shard_count > 0 && gb_shard_by_size )
+      for ( auto& arg : archives ) {
+        std::string prefix = arg + "/";
+        archiveReadMembers( arg.c_str(), []( InputFile& ) { return 0; }, [&]( const std::string& name, int64_t size ) {
+          DiscoveredFile file;
+          file.path = prefix + name;
+          file.relpath = name;
+          file.size = size;
+          items.push_back( file );
+          members.insert( file.path );
+          return false;
+        } );
+      }
+#endif
+
+    if ( gb_shard_count > 0 && gb_shard_by_size ) {
+      items = selectShard( items );
+      std::vector<DiscoveredFile> shard_items;
+      for ( auto& item : items )
+        if ( members.find(item.path) != members.end() )
+          shard_members.insert( item.path );
+        else
+          shard_items.push_back( item );
+      items.swap( shard_items );
+    }
+    std::stable_sort( items.begin(), items.end(), []( const DiscoveredFile& a, const DiscoveredFile& b ) { return a.size > b.size; } );
+
+    auto processItem = [&]( const std::vector<InputFile>& single, const std::string& relpath ) {
+      if ( done.find(single[0].name) != done.end() )
+        return 0;
+      int r = processInputsTo( tessApi, single, xmlPathFor(relpath), out_archive );
+      if ( r == 0 && progress != NULL ) {
+        fprintf( progress, "%s\n", single[0].name.c_str() );
+        fflush( progress );
+      }
+      return r;
+    };
+
+    for ( auto& item : items ) {
+      std::vector<InputFile> single(1);
+      single[0].name = item.path;
+      failed += processItem( single, item.relpath );
+    }
+
+    for ( auto& arg : archives ) {
+#ifdef __TESSREC_LIBARCHIVE__
+      std::string prefix = arg + "/";
+      int collisions = 0;
+      int r = archiveReadMembers( arg.c_str(), [&]( InputFile& member ) {
+        std::string relpath = member.name;
+        member.name = prefix + member.name;
+        std::vector<InputFile> single(1);
+        single[0] = std::move(member);
+        return processItem( single, relpath );
+      }, [&]( const std::string& name, int64_t ) {
+        /// Only members of this shard not already done are decompressed ///
+        std::string path = prefix + name;
+        if ( ! claimOutput( path, name ) ) {
+          collisions++;
+          return false;
+        }
+        if ( gb_shard_count > 0 && ( gb_shard_by_size ?
+               shard_members.find(path) == shard_members.end() :
+               hashShard(name) != gb_shard_index ) )
+          return false;
+        return done.find(path) == done.end();
+      } );
+      failed += collisions;
+      failed += r < 0 ? 1 : r;
+#else
+      logError( "archive input requires compiling with libarchive: %s", arg.c_str() );
+      failed++;
+#endif
+    }
+
+    if ( progress != NULL )
+      fclose( progress );
+  }
+
+  /// Release resources ///
+#ifdef __TESSREC_LIBARCHIVE__
+  if ( out_archive != NULL ) {
+    if ( archive_write_close( out_archive ) != ARCHIVE_OK ) {
+      logError( "problems writing output archive: %s :: %s", gb_output_archive, archive_error_string(out_archive) );
+      failed++;
+    }
+    archive_write_free( out_archive );
+  }
+#endif
+  endTesseract( tessApi );
+  logContext( "", 0 );
+
+  return failed ? 1 : 0;
 }
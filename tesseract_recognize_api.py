@@ -20,12 +20,13 @@ import shutil
 import queue
 import threading
 import tempfile
+import uuid
 import pagexml
 from time import time
 from functools import wraps
 from subprocess import Popen, PIPE, STDOUT
 from jsonargparse import ArgumentParser, ActionConfigFile, ActionYesNo
-from flask import Flask, Response, abort
+from flask import Flask, Response, abort, request
 from flask_restx import Api, Resource, reqparse
 from werkzeug.datastructures import FileStorage
 from werkzeug.exceptions import BadRequest
@@ -252,8 +253,9 @@ if __name__ == '__main__':
         def post(self, req_dict):
             """Endpoint for running tesseract-recognize on given images or page xml file."""
             start_time = time()
+            request_id = request.headers.get('X-Request-ID', uuid.uuid4().hex)
             done_queue = queue.Queue()
-            process_queue.put((done_queue, req_dict))
+            process_queue.put((done_queue, req_dict, request_id))
             while True:
                 try:
                     thread, num_requests, pxml = done_queue.get(True, 0.05)
@@ -261,11 +263,11 @@ if __name__ == '__main__':
                 except queue.Empty:
                     continue
             if isinstance(pxml, Exception):
-                app.logger.error('Request '+str(num_requests)+' on thread '+str(thread)+' unsuccessful, '
+                app.logger.error('Request '+str(num_requests)+' ('+request_id+') on thread '+str(thread)+' unsuccessful, '
                                  +('%.4g' % (time()-start_time))+' sec. :: '+str(pxml))
                 abort(400, 'processing failed :: '+str(pxml))
             else:
-                app.logger.info('Request '+str(num_requests)+' on thread '+str(thread)+' successful, '
+                app.logger.info('Request '+str(num_requests)+' ('+request_id+') on thread '+str(thread)+' successful, '
                                 +('%.4g' % (time()-start_time))+' sec.')
                 return pxml
 
@@ -280,7 +282,7 @@ if __name__ == '__main__':
         tmpdir = None
         while True:
             try:
-                done_queue, req_dict = process_queue.get(True, 0.05)
+                done_queue, req_dict, request_id = process_queue.get(True, 0.05)
                 num_requests += 1
                 tmpdir = write_to_tmpdir(req_dict)
 
@@ -295,8 +297,11 @@ if __name__ == '__main__':
                 else:
                     raise KeyError('No images found in request.')
                 opts.extend(['-o', os.path.join(tmpdir, 'output.xml')])
+                opts.extend(['--log-json', '--request-id', request_id])
 
                 rc, out = run_tesseract_recognize(*opts)
+                if out:
+                    sys.stderr.write(out if out.endswith('\n') else out+'\n')
                 if rc != 0:
                     raise RuntimeError('tesseract-recognize execution failed :: opts: '+str(opts)+' :: '+str(out))
 
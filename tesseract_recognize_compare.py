@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+"""Runs tesseract-recognize serially and in faster modes, comparing the Page XMLs and the times,
+or checks that the elements dropped by --min-conf are in none of the outputs."""
+
+"""
+@version $Version: 2024.04.16$
+@author Mauricio Villegas <mauricio_ville@yahoo.com>
+@copyright Copyright(c) 2017-present, Mauricio Villegas <mauricio_ville@yahoo.com>
+"""
+
+import os
+import sys
+import shlex
+import argparse
+import tempfile
+import subprocess
+import xml.etree.ElementTree as ET
+from time import time
+from statistics import median
+
+
+def get_cli_parser():
+    """Returns the parser object for the command line tool."""
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        epilog='example: %(prog)s --mode="--threads 4" --mode="--profile fast" in.pdf')
+
+    parser.add_argument('--tool',
+        default='tesseract-recognize',
+        help='Path to the tesseract-recognize binary.')
+    parser.add_argument('--options',
+        default='',
+        help='Options given to all runs, given as --options="OPTIONS".')
+    parser.add_argument('--mode',
+        action='append',
+        default=[],
+        help='Options of a mode compared with the plain serial run, given as --mode="OPTIONS", can be repeated.')
+    parser.add_argument('--coords-tol',
+        type=float,
+        default=0.0,
+        help='Tolerance in pixels for the Coords and Baseline points.')
+    parser.add_argument('--conf-tol',
+        type=float,
+        default=1e-4,
+        help='Tolerance for the confidences.')
+    parser.add_argument('--runs',
+        type=int,
+        default=3,
+        help='Number of timed runs of each mode after an untimed warm-up run, the median time is reported.')
+    parser.add_argument('--max-diffs',
+        type=int,
+        default=20,
+        help='Maximum number of differences printed per mode.')
+    parser.add_argument('--check-min-conf',
+        type=float,
+        metavar='CONF',
+        help='Instead of comparing modes, check that what --min-conf CONF drops is in none of the outputs.')
+    parser.add_argument('--keep',
+        help='Directory where to keep the Page XMLs, by default a temporary one.')
+    parser.add_argument('inputs',
+        nargs='+',
+        help='Inputs to recognize, processed into a single Page XML.')
+
+    return parser
+
+
+def run_tool(cfg, options, output, runs=None):
+    """Runs tesseract-recognize once to warm up the caches and then cfg.runs
+    times, or the given number of runs, returning the median of the elapsed
+    times in seconds, zero if there are no timed runs."""
+    cmd = [cfg.tool] + shlex.split(cfg.options) + shlex.split(options) + ['-o', output] + cfg.inputs
+    times = []
+    for run in range((cfg.runs if runs is None else runs)+1):
+        start = time()
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+        elapsed = time() - start
+        if proc.returncode != 0:
+            raise RuntimeError('command failed: '+' '.join(shlex.quote(c) for c in cmd)+'\n'+proc.stdout)
+        if run > 0:
+            times.append(elapsed)
+    return median(times) if times else 0.0
+
+
+def local_name(elem):
+    """Element name without namespace."""
+    return elem.tag.rsplit('}', 1)[-1]
+
+
+def child(elem, name):
+    """First child element with the given name, None if there is none."""
+    for ch in elem:
+        if local_name(ch) == name:
+            return ch
+    return None
+
+
+def points(elem, name):
+    """Points of a child element such as Coords or Baseline, None if there is no such child."""
+    ch = child(elem, name)
+    if ch is None:
+        return None
+    return [tuple(float(v) for v in p.split(',')) for p in ch.get('points', '').split()]
+
+
+def text_equivs(elem):
+    """Index, text and confidence of each TextEquiv of an element, in order."""
+    equivs = []
+    for te in elem:
+        if local_name(te) == 'TextEquiv':
+            uni = child(te, 'Unicode')
+            equivs.append((te.get('index'), '' if uni is None or uni.text is None else uni.text, te.get('conf')))
+    return equivs
+
+
+def compare_element(elem, ref_elem, cfg):
+    """Compares an element with the one with the same id in the reference."""
+    diffs = []
+    eid = ref_elem.get('id')
+    if local_name(elem) != local_name(ref_elem):
+        diffs.append('element %s is %s in the reference id=%s' % (local_name(elem), local_name(ref_elem), eid))
+    for geometry in ['Coords', 'Baseline']:
+        pts = points(elem, geometry)
+        ref_pts = points(ref_elem, geometry)
+        differ = (pts is None) != (ref_pts is None) or (pts is not None and len(pts) != len(ref_pts))
+        if not differ and pts is not None:
+            differ = any(abs(a-b) > cfg.coords_tol for p, q in zip(pts, ref_pts) for a, b in zip(p, q))
+        if differ:
+            diffs.append('%s differ: %s vs. %s in the reference id=%s' % (geometry, pts, ref_pts, eid))
+    equivs = text_equivs(elem)
+    ref_equivs = text_equivs(ref_elem)
+    if len(equivs) != len(ref_equivs):
+        diffs.append('%d TextEquivs vs. %d in the reference id=%s' % (len(equivs), len(ref_equivs), eid))
+    for (index, text, conf), (ref_index, ref_text, ref_conf) in zip(equivs, ref_equivs):
+        if index != ref_index:
+            diffs.append('TextEquiv index %s vs. %s in the reference id=%s' % (index, ref_index, eid))
+        if text != ref_text:
+            diffs.append('text differs: "%s" vs. "%s" in the reference id=%s index=%s' % (text, ref_text, eid, ref_index))
+        if (conf is None) != (ref_conf is None) or (conf is not None and abs(float(conf)-float(ref_conf)) > cfg.conf_tol):
+            diffs.append('conf differs: %s vs. %s in the reference id=%s index=%s' % (conf, ref_conf, eid, ref_index))
+    return diffs
+
+
+def compare_xml(xml_file, ref_file, cfg):
+    """Compares a Page XML structurally with a reference: size of the pages,
+    ids of the elements and their order, and for each id the element name,
+    Coords and Baseline, and the text and confidence of each TextEquiv within
+    the tolerances."""
+    pages = [e for e in ET.parse(xml_file).iter() if local_name(e) == 'Page']
+    ref_pages = [e for e in ET.parse(ref_file).iter() if local_name(e) == 'Page']
+    diffs = []
+    if len(pages) != len(ref_pages):
+        diffs.append('%d pages vs. %d in the reference' % (len(pages), len(ref_pages)))
+    for num, (page, ref_page) in enumerate(zip(pages, ref_pages)):
+        if (page.get('imageWidth'), page.get('imageHeight')) != (ref_page.get('imageWidth'), ref_page.get('imageHeight')):
+            diffs.append('size of page %d differs from the reference' % (num+1))
+
+    elems = [e for p in pages for e in p.iter() if e is not p and e.get('id') is not None]
+    ref_elems = [e for p in ref_pages for e in p.iter() if e is not p and e.get('id') is not None]
+    ids = {e.get('id'): e for e in elems}
+    ref_ids = set()
+    order_reported = False
+    for num, ref_elem in enumerate(ref_elems):
+        eid = ref_elem.get('id')
+        ref_ids.add(eid)
+        if eid not in ids:
+            diffs.append('missing element %s id=%s' % (local_name(ref_elem), eid))
+            continue
+        if not order_reported and (num >= len(elems) or elems[num] is not ids[eid]):
+            diffs.append('order of the elements differs starting at id=%s' % eid)
+            order_reported = True
+        diffs += compare_element(ids[eid], ref_elem, cfg)
+    for eid, elem in ids.items():
+        if eid not in ref_ids:
+            diffs.append('extra element %s id=%s' % (local_name(elem), eid))
+    return diffs, len(elems)
+
+
+def has_property(elem, key):
+    """Whether an element has a Property with the given key."""
+    return any(local_name(ch) == 'Property' and ch.get('key') == key for ch in elem)
+
+
+def text_of(elem):
+    """Text of the first TextEquiv of an element, None if it has none."""
+    equivs = text_equivs(elem)
+    return equivs[0][1] if equivs else None
+
+
+def check_min_conf(cfg, outdir):
+    """Runs with --min-conf-flag to know the elements that --min-conf drops,
+    then with --min-conf and all the outputs, and checks that the ids of the
+    dropped elements are in none of the outputs, that there are no lines
+    without words, and that the text of the lines and regions in the Page
+    XML, the TSV and the plain text is that of the kept words."""
+    options = shlex.split(cfg.options)
+    level = 'word'
+    for num, opt in enumerate(options):
+        if opt == '--min-conf-level' and num+1 < len(options):
+            level = options[num+1]
+        elif opt.startswith('--min-conf-level='):
+            level = opt.split('=', 1)[1]
+    min_conf = '--min-conf %g' % cfg.check_min_conf
+    flagged_file = os.path.join(outdir, 'flagged.xml')
+    run_tool(cfg, min_conf+' --min-conf-flag', flagged_file, runs=0)
+    name = 'TextLine' if level == 'line' else 'Word'
+    dropped = [e.get('id') for e in ET.parse(flagged_file).iter() if local_name(e) == name and has_property(e, 'low-confidence')]
+
+    pruned_file = os.path.join(outdir, 'pruned.xml')
+    run_tool(cfg, min_conf+' --text .txt --tsv .tsv --alto .alto.xml --hocr .html', pruned_file, runs=0)
+    base = pruned_file[:-len('.xml')]
+    diffs = []
+
+    ids = {
+        'Page XML': set(e.get('id') for e in ET.parse(pruned_file).iter()),
+        'ALTO': set(e.get('ID') for e in ET.parse(base+'.alto.xml').iter()),
+        'hOCR': set(e.get('id') for e in ET.parse(base+'.html').iter()),
+    }
+    with open(base+'.tsv', encoding='utf-8') as tsv:
+        rows = [(r.rstrip('\n').split('\t')+['']*9)[:9] for r in tsv][1:]
+    ids['TSV'] = set(r[2] for r in rows)
+    for eid in dropped:
+        for fmt, fmt_ids in ids.items():
+            if eid in fmt_ids:
+                diffs.append('dropped %s id=%s is in the %s' % (name, eid, fmt))
+
+    lines = []
+    for elem in ET.parse(pruned_file).iter():
+        if local_name(elem) == 'TextRegion':
+            reg_lines = [e for e in elem if local_name(e) == 'TextLine']
+            reg_text = text_of(elem)
+            if reg_text is not None and [t for t in reg_text.split('\n') if t] != [text_of(e) for e in reg_lines]:
+                diffs.append('text of region id=%s is not that of its lines' % elem.get('id'))
+        if local_name(elem) != 'TextLine':
+            continue
+        lines.append(text_of(elem))
+        words = [e for e in elem if local_name(e) == 'Word']
+        if level == 'word' and not words:
+            diffs.append('line id=%s without words' % elem.get('id'))
+        elif level == 'word' and lines[-1] is not None and None not in [text_of(e) for e in words] and \
+                lines[-1] != ' '.join(text_of(e) for e in words):
+            diffs.append('text of line id=%s in the Page XML is not that of its words' % elem.get('id'))
+
+    tsv_line = None
+    for row in rows + [['', 'line', '', '', '', '', '', '', '']]:
+        if row[1] in {'region', 'line'} and tsv_line is not None and level == 'word' and \
+                tsv_line[0] and all(tsv_line[1]) and tsv_line[0] != ' '.join(tsv_line[1]):
+            diffs.append('text of line id=%s in the TSV is not that of its words' % tsv_line[2])
+        if row[1] == 'line':
+            tsv_line = (row[8], [], row[2])
+        elif row[1] == 'word' and tsv_line is not None:
+            tsv_line[1].append(row[8])
+
+    with open(base+'.txt', encoding='utf-8') as txt:
+        txt_lines = [t for t in txt.read().replace('\f', '\n').split('\n') if t]
+    if None not in lines and txt_lines != lines:
+        diffs.append('plain text lines are not those of the Page XML')
+
+    return diffs, len(dropped)
+
+
+def main():
+    """Main function for the command line tool."""
+    cfg = get_cli_parser().parse_args()
+    if not cfg.mode and cfg.check_min_conf is None:
+        print('error: at least one --mode or --check-min-conf is required', file=sys.stderr)
+        return 2
+    if cfg.runs < 1:
+        print('error: --runs has to be at least 1', file=sys.stderr)
+        return 2
+
+    tmpdir = None
+    outdir = cfg.keep
+    if outdir is None:
+        tmpdir = tempfile.TemporaryDirectory(prefix='tesseract_recognize_compare_')
+        outdir = tmpdir.name
+    else:
+        os.makedirs(outdir, exist_ok=True)
+
+    try:
+        if cfg.check_min_conf is not None:
+            diffs, num_dropped = check_min_conf(cfg, outdir)
+            print('--min-conf %g: %d dropped, %d problems' % (cfg.check_min_conf, num_dropped, len(diffs)))
+            for diff in diffs[:cfg.max_diffs]:
+                print('  '+diff)
+            if len(diffs) > cfg.max_diffs:
+                print('  ... %d more' % (len(diffs)-cfg.max_diffs))
+            return 1 if diffs else 0
+
+        ref_file = os.path.join(outdir, 'serial.xml')
+        ref_time = run_tool(cfg, '', ref_file)
+        print('serial: %.2f s' % ref_time)
+
+        failed = 0
+        for num, mode in enumerate(cfg.mode):
+            xml_file = os.path.join(outdir, 'mode%d.xml' % (num+1))
+            mode_time = run_tool(cfg, mode, xml_file)
+            diffs, num_elems = compare_xml(xml_file, ref_file, cfg)
+            print('%s: %.2f s, speedup %.2fx, %d differences in %d elements' %
+                  (mode, mode_time, ref_time/mode_time if mode_time > 0 else float('inf'), len(diffs), num_elems))
+            for diff in diffs[:cfg.max_diffs]:
+                print('  '+diff)
+            if len(diffs) > cfg.max_diffs:
+                print('  ... %d more' % (len(diffs)-cfg.max_diffs))
+            if diffs:
+                failed += 1
+    except (RuntimeError, OSError, ET.ParseError) as ex:
+        print('error: %s' % ex, file=sys.stderr)
+        return 2
+    finally:
+        if tmpdir is not None:
+            tmpdir.cleanup()
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())